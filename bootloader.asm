@@ -26,13 +26,26 @@ start:
     test cx, 0x0001
     jz disk_error
 
-    ; Build DAP at 0x0600 and read KERNEL_SECTORS from LBA 1 into 0x1000
+    ; Read KERNEL_SECTORS from LBA 1 into KERNEL_SEG:0000 in chunks of at
+    ; most LOAD_CHUNK sectors, using a DAP built at 0x0600. Chunks are 32 KiB
+    ; aligned so no transfer crosses a 64 KiB boundary.
+load_loop:
+    mov ax, [sectors_left]
+    test ax, ax
+    jz load_done
+    cmp ax, LOAD_CHUNK
+    jbe .chunk_ok
+    mov ax, LOAD_CHUNK
+.chunk_ok:
+    mov [chunk_sectors], ax
     mov byte [DAP_PTR], 0x10
     mov byte [DAP_PTR + 1], 0x00
-    mov word [DAP_PTR + 2], KERNEL_SECTORS
-    mov word [DAP_PTR + 4], 0x1000
-    mov word [DAP_PTR + 6], 0x0000
-    mov dword [DAP_PTR + 8], 1
+    mov [DAP_PTR + 2], ax
+    mov word [DAP_PTR + 4], 0x0000
+    mov bx, [load_seg]
+    mov [DAP_PTR + 6], bx
+    mov ebx, [load_lba]
+    mov [DAP_PTR + 8], ebx
     mov dword [DAP_PTR + 12], 0
 
     mov si, DAP_PTR
@@ -41,7 +54,43 @@ start:
     int 0x13
     jc disk_error
 
+    mov ax, [chunk_sectors]
+    sub [sectors_left], ax
+    movzx ebx, ax
+    add [load_lba], ebx
+    shl ax, 5
+    add [load_seg], ax
+    jmp load_loop
+
 load_done:
+    ; Collect the BIOS memory map (INT 15h, E820) for the kernel: a dword
+    ; entry count at E820_MAP followed by 24-byte entries.
+    mov di, E820_MAP + 8
+    xor ebx, ebx
+    xor bp, bp
+.e820_next:
+    mov eax, 0xE820
+    mov edx, E820_SMAP
+    mov ecx, 24
+    mov dword [di + 20], 1
+    int 0x15
+    jc .e820_done
+    cmp eax, E820_SMAP
+    jne .e820_done
+    mov eax, [di + 8]
+    or eax, [di + 12]
+    jz .e820_skip
+    inc bp
+    add di, 24
+    cmp bp, E820_MAX
+    jae .e820_done
+.e820_skip:
+    test ebx, ebx
+    jnz .e820_next
+.e820_done:
+    mov [E820_MAP], bp
+    mov word [E820_MAP + 2], 0
+
     ; Enable A20 (fast A20 gate)
     in al, 0x92
     or al, 0x02
@@ -73,8 +122,9 @@ protected_mode:
     mov ss, ax
     mov esp, 0x90000
 
-    ; Jump to kernel entry at 0x1000 (absolute far jump)
-    jmp CODE_SEG:0x1000
+    ; Jump to kernel entry (absolute far jump); EBX carries the memory map
+    mov ebx, E820_MAP
+    jmp CODE_SEG:KERNEL_ADDR
 
 ; GDT
 [bits 16]
@@ -96,7 +146,17 @@ DATA_SEG equ 0x10
 %define KERNEL_SECTORS 35
 %endif
 DAP_PTR equ 0x0600
+E820_MAP equ 0x1000
+E820_MAX equ 64
+E820_SMAP equ 0x534D4150
+KERNEL_SEG equ 0x1000
+KERNEL_ADDR equ KERNEL_SEG * 16
+LOAD_CHUNK equ 64
 boot_drive: db 0
+sectors_left: dw KERNEL_SECTORS
+chunk_sectors: dw 0
+load_seg: dw KERNEL_SEG
+load_lba: dd 1
 
 print_string:
     push ax
@@ -0,0 +1,37 @@
+#ifndef ARCH_CPU_H
+#define ARCH_CPU_H
+
+#include <stdint.h>
+
+void cpu_irq_enable(void);
+void cpu_irq_disable(void);
+uint32_t cpu_irq_save(void);
+int cpu_irq_enabled(void);
+void cpu_irq_restore(uint32_t flags);
+void cpu_halt(void);
+/* Enables interrupts and halts atomically, then masks them again. */
+void cpu_idle(void);
+void cpu_cpuid(uint32_t leaf, uint32_t *eax, uint32_t *ebx, uint32_t *ecx, uint32_t *edx);
+uint64_t cpu_rdtsc(void);
+int cpu_has_tsc(void);
+int cpu_has_sse2(void);
+uint64_t cpu_rdmsr(uint32_t msr);
+void cpu_wrmsr(uint32_t msr, uint64_t value);
+
+/*
+ * Enables x87/SSE for this CPU (CR0.MP/NE, CR4.OSFXSR/OSXMMEXCPT). Returns
+ * -1 when FXSAVE or SSE is missing, in which case lazy switching stays off.
+ */
+int cpu_fpu_init(void);
+/* Whether cpu_fpu_init has turned SSE on for this CPU. */
+int cpu_fpu_enabled(void);
+/* CR0.TS: the next FPU/SSE instruction raises #NM. */
+void cpu_fpu_trap_next(void);
+void cpu_fpu_allow(void);
+/* Fresh x87/SSE state: FNINIT plus the default MXCSR. */
+void cpu_fpu_reset(void);
+/* 512-byte, 16-byte aligned save area. */
+void cpu_fxsave(void *area);
+void cpu_fxrstor(const void *area);
+
+#endif
@@ -0,0 +1,28 @@
+#ifndef ARCH_E820_H
+#define ARCH_E820_H
+
+#include <stdint.h>
+
+#define E820_USABLE 1
+#define E820_RESERVED 2
+#define E820_ACPI_RECLAIM 3
+#define E820_ACPI_NVS 4
+#define E820_BAD 5
+
+typedef struct
+{
+  uint64_t base;
+  uint64_t length;
+  uint32_t type;
+  uint32_t acpi;
+} __attribute__((packed)) e820_entry_t;
+
+/* Built by the bootloader below 1 MiB before entering protected mode. */
+typedef struct
+{
+  uint32_t count;
+  uint32_t reserved;
+  e820_entry_t entries[];
+} __attribute__((packed)) e820_map_t;
+
+#endif
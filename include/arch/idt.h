@@ -0,0 +1,37 @@
+#ifndef ARCH_IDT_H
+#define ARCH_IDT_H
+
+#include <stdint.h>
+
+#define IDT_EXCEPTION_COUNT 32
+/* Inter-processor interrupts sit right after the remapped PIC range. */
+#define IDT_IPI_BASE 0x30
+#define IDT_IPI_COUNT 4
+
+typedef struct
+{
+  uint32_t edi;
+  uint32_t esi;
+  uint32_t ebp;
+  uint32_t esp;
+  uint32_t ebx;
+  uint32_t edx;
+  uint32_t ecx;
+  uint32_t eax;
+  uint32_t vector;
+  uint32_t error;
+  uint32_t eip;
+  uint32_t cs;
+  uint32_t eflags;
+} interrupt_frame_t;
+
+typedef void (*irq_handler_t)(interrupt_frame_t *frame);
+
+void idt_init(void);
+/* Loads the shared IDT on a CPU that did not build it. */
+void idt_load(void);
+int irq_register(uint8_t irq, irq_handler_t handler);
+int ipi_register(uint8_t vector, irq_handler_t handler);
+void isr_dispatch(interrupt_frame_t *frame);
+
+#endif
@@ -0,0 +1,23 @@
+#ifndef ARCH_LAPIC_H
+#define ARCH_LAPIC_H
+
+#include <stdint.h>
+
+/* Spurious interrupts need no EOI, so the vector gets a bare IRET stub. */
+#define LAPIC_SPURIOUS_VECTOR 0xFF
+
+int lapic_present(void);
+/*
+ * Enables this CPU's local APIC; only the boot CPU takes legacy PIC IRQs.
+ * The boot CPU maps the register page first; -1 if that fails.
+ */
+int lapic_init(int bsp);
+uint8_t lapic_id(void);
+void lapic_eoi(void);
+void lapic_send_ipi(uint8_t apic_id, uint8_t vector);
+/* Fixed IPI to every CPU except the sender. */
+void lapic_broadcast_ipi(uint8_t vector);
+void lapic_send_init_all(void);
+void lapic_send_startup_all(uint32_t trampoline);
+
+#endif
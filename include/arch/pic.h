@@ -0,0 +1,15 @@
+#ifndef ARCH_PIC_H
+#define ARCH_PIC_H
+
+#include <stdint.h>
+
+#define PIC_IRQ_BASE 0x20
+#define PIC_IRQ_COUNT 16
+
+void pic_init(void);
+void pic_mask(uint8_t irq);
+void pic_unmask(uint8_t irq);
+void pic_send_eoi(uint8_t irq);
+int pic_is_spurious(uint8_t irq);
+
+#endif
@@ -0,0 +1,35 @@
+#ifndef ARCH_SMP_H
+#define ARCH_SMP_H
+
+#include <stdint.h>
+#include "arch/idt.h"
+
+#define SMP_MAX_CPUS 8
+
+#define SMP_IPI_TICK (IDT_IPI_BASE + 0)
+#define SMP_IPI_RESCHEDULE (IDT_IPI_BASE + 1)
+#define SMP_IPI_STOP (IDT_IPI_BASE + 2)
+#define SMP_IPI_TLB (IDT_IPI_BASE + 3)
+
+/* smp_tlb_shootdown address that reloads CR3 instead of one invlpg. */
+#define SMP_TLB_FLUSH_ALL 0xFFFFFFFFu
+
+/*
+ * Starts the application processors with INIT-SIPI-SIPI. Each one enables
+ * its local APIC and joins the scheduler as an idle CPU. Without a local
+ * APIC (or a TSC to time the startup delays) the kernel stays uniprocessor.
+ */
+void smp_init(void);
+uint32_t smp_cpu_count(void);
+/* Dense CPU index, 0 for the boot CPU. Call with interrupts disabled. */
+uint32_t smp_cpu_id(void);
+void smp_broadcast_tick(void);
+void smp_send_reschedule(uint32_t cpu);
+void smp_stop_others(void);
+/*
+ * Invalidates virt on every other CPU and waits until they all have. The
+ * caller must not hold a lock another CPU could be spinning on.
+ */
+void smp_tlb_shootdown(uintptr_t virt);
+
+#endif
@@ -0,0 +1,54 @@
+#ifndef ARCH_SPINLOCK_H
+#define ARCH_SPINLOCK_H
+
+#include <stdint.h>
+#include "arch/cpu.h"
+
+/*
+ * Test-and-test-and-set lock. Waiters spin on a plain read so the cache
+ * line is only fought over when the lock is released. Every lock in the
+ * kernel is also taken from interrupt handlers, so use the _irqsave forms:
+ * an interrupt on the owning CPU would otherwise spin forever.
+ */
+typedef struct
+{
+  volatile uint32_t locked;
+} spinlock_t;
+
+#define SPINLOCK_INIT {0}
+
+static inline void spin_init(spinlock_t *lock)
+{
+  lock->locked = 0;
+}
+
+static inline void spin_lock(spinlock_t *lock)
+{
+  while (__atomic_exchange_n(&lock->locked, 1u, __ATOMIC_ACQUIRE))
+  {
+    while (lock->locked)
+    {
+      __asm__ __volatile__("pause" : : : "memory");
+    }
+  }
+}
+
+static inline void spin_unlock(spinlock_t *lock)
+{
+  __atomic_store_n(&lock->locked, 0u, __ATOMIC_RELEASE);
+}
+
+static inline uint32_t spin_lock_irqsave(spinlock_t *lock)
+{
+  uint32_t flags = cpu_irq_save();
+  spin_lock(lock);
+  return flags;
+}
+
+static inline void spin_unlock_irqrestore(spinlock_t *lock, uint32_t flags)
+{
+  spin_unlock(lock);
+  cpu_irq_restore(flags);
+}
+
+#endif
@@ -15,6 +15,12 @@ typedef enum {
 	KEY_RIGHT,
 } keyboard_key_t;
 
+/* Decoded key from the IRQ ring, or 0 when nothing is pending. */
 int keyboard_poll_key(void);
+/* Blocks the calling process until a key arrives. */
+int keyboard_read_key(void);
+/* Polls the controller directly; for use with interrupts disabled. */
+int keyboard_poll_raw(void);
+uint32_t keyboard_dropped(void);
 
 #endif
@@ -0,0 +1,12 @@
+#ifndef PIT_H
+#define PIT_H
+
+#include <stdint.h>
+
+#define PIT_BASE_HZ 1193182u
+#define PIT_TICK_HZ 1000u
+
+int pit_init(void);
+uint64_t pit_ticks(void);
+
+#endif
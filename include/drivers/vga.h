@@ -3,10 +3,21 @@
 
 #include <stdint.h>
 
+/* Output lands in a RAM shadow and reaches the screen this long after the first change. */
+#define VGA_FLUSH_MS 10
+
 int vga_init(void);
+/* Pushes pending changes to the screen now. */
+void vga_flush(void);
+/*
+ * For panic, with the other CPUs stopped: takes the screen over even if
+ * its lock was held, and makes every later call write straight through.
+ */
+void vga_emergency(void);
 void vga_clear(void);
 void vga_write(const char *str, uint16_t row, uint16_t col);
 void vga_putc(char ch);
+void vga_puts(const char *str);
 void vga_set_color(uint8_t fg, uint8_t bg);
 uint8_t vga_get_color(void);
 void vga_set_cursor(uint16_t row, uint16_t col);
@@ -0,0 +1,24 @@
+#ifndef LIB_DIV64_H
+#define LIB_DIV64_H
+
+#include <stdint.h>
+
+/*
+ * 64-by-32 division without libgcc: the high half is divided first, so its
+ * remainder keeps the second divl from overflowing.
+ */
+static inline uint64_t u64_div_u32(uint64_t value, uint32_t divisor, uint32_t *remainder)
+{
+  uint32_t high = (uint32_t)(value >> 32);
+  uint32_t rem = high % divisor;
+  uint32_t quot_high = high / divisor;
+  uint32_t quot_low;
+  __asm__("divl %4" : "=a"(quot_low), "=d"(rem) : "a"((uint32_t)value), "d"(rem), "rm"(divisor));
+  if (remainder)
+  {
+    *remainder = rem;
+  }
+  return ((uint64_t)quot_high << 32) | quot_low;
+}
+
+#endif
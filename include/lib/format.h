@@ -0,0 +1,17 @@
+#ifndef LIB_FORMAT_H
+#define LIB_FORMAT_H
+
+#include <stddef.h>
+#include <stdint.h>
+#include "lib/div64.h"
+
+/* Buffer sizes including the terminator. */
+#define FMT_U64_MAX 21
+#define FMT_HEX32_MAX 11
+
+/* Decimal, terminated; returns the digit count. */
+size_t fmt_u64(char *buf, uint64_t value);
+/* "0x" and eight upper-case digits, terminated; returns 10. */
+size_t fmt_hex32(char *buf, uint32_t value);
+
+#endif
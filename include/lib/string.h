@@ -0,0 +1,31 @@
+#ifndef LIB_STRING_H
+#define LIB_STRING_H
+
+#include <stddef.h>
+
+/*
+ * Copies and fills run on rep movsd/stosd. Once string_init has seen SSE2
+ * and the FPU enabled, large ones use 16-byte vector moves instead, but
+ * only with interrupts on: interrupt handlers and spinlock holders never
+ * touch XMM state, and everyone else gets it saved by lazy FPU switching.
+ */
+#define STRING_SIMD_MIN 256
+
+void string_init(void);
+/* Name of the copy routine in use, for reporting. */
+const char *string_impl(void);
+
+void *memcpy(void *dst, const void *src, size_t n);
+void *memmove(void *dst, const void *src, size_t n);
+void *memset(void *dst, int value, size_t n);
+size_t strlen(const char *s);
+int strcmp(const char *a, const char *b);
+/* Copies at most dst_len - 1 characters and terminates; returns the count. */
+size_t str_copy(char *dst, size_t dst_len, const char *src);
+
+static inline int str_eq(const char *a, const char *b)
+{
+  return strcmp(a, b) == 0;
+}
+
+#endif
@@ -0,0 +1,32 @@
+#ifndef MM_ARENA_H
+#define MM_ARENA_H
+
+#include <stddef.h>
+#include <stdint.h>
+#include "arch/spinlock.h"
+
+struct arena_chunk;
+
+/*
+ * Bump-pointer allocator over a chain of chunks. Objects are never freed
+ * one by one; arena_release returns every chunk at once. One owner
+ * allocates, but the release can come from another CPU (a forced kill), so
+ * both sides take the arena's lock.
+ */
+typedef struct
+{
+  struct arena_chunk *chunks;
+  size_t used;
+  size_t reserved;
+  spinlock_t lock;
+} arena_t;
+
+#define ARENA_INIT {0, 0, 0, SPINLOCK_INIT}
+/* Default chunk size; larger requests get a chunk of their own size. */
+#define ARENA_CHUNK_SIZE 4096u
+
+void arena_init(arena_t *arena);
+void *arena_alloc(arena_t *arena, size_t size);
+void arena_release(arena_t *arena);
+
+#endif
@@ -2,9 +2,18 @@
 #define MM_HEAP_H
 
 #include <stddef.h>
+#include <stdint.h>
+
+/* Regions added when the heap runs dry, each taken from the page allocator. */
+#define HEAP_MAX_REGIONS 16
+#define HEAP_GROW_MIN_ORDER 4
 
 void heap_init(void *base, size_t size);
 void *kmalloc(size_t size);
+/* align must be a power of two; the result is freed with kfree. */
+void *kmalloc_aligned(size_t size, size_t align);
+/* Resizes in place when it can, otherwise moves; NULL leaves ptr untouched. */
+void *krealloc(void *ptr, size_t size);
 void kfree(void *ptr);
 
 typedef struct
@@ -18,8 +27,37 @@ typedef struct
 	size_t blocks;
 	size_t free_blocks;
 	size_t largest_free;
+	size_t regions;
 } heap_stats_t;
 
 void heap_get_stats(heap_stats_t *out);
 
+/* One in HEAP_PROFILE_SAMPLE_EVERY allocations is sampled by call site. */
+#define HEAP_PROFILE_SAMPLE_EVERY 16u
+#define HEAP_PROFILE_BUCKETS 12
+#define HEAP_PROFILE_SITES 32
+
+typedef struct
+{
+	uintptr_t site;
+	uint32_t samples;
+	uint64_t bytes;
+} heap_profile_site_t;
+
+typedef struct
+{
+	uint32_t allocations;
+	uint32_t samples;
+	uint32_t dropped_sites;
+	size_t in_use;
+	size_t peak;
+	/* Sampled sizes by power of two: <=16, 32, 64, ... and a catch-all. */
+	uint32_t size_buckets[HEAP_PROFILE_BUCKETS];
+} heap_profile_t;
+
+void heap_profile_get(heap_profile_t *out);
+/* Copies up to max sampled call sites, heaviest by bytes first. */
+size_t heap_profile_top(heap_profile_site_t *out, size_t max);
+void heap_profile_reset(void);
+
 #endif
@@ -0,0 +1,35 @@
+#ifndef MM_HEAP_BACKEND_H
+#define MM_HEAP_BACKEND_H
+
+#include <stddef.h>
+#include "mm/heap.h"
+
+/*
+ * Allocator behind kmalloc for everything the slab caches do not take.
+ * Exactly one implementation is linked, picked by HEAP_BACKEND in the
+ * Makefile. Each does its own locking and returns 8-byte aligned memory.
+ */
+void heap_backend_init(void *base, size_t size);
+/* Hands the backend another region; it need not touch the earlier ones. */
+void heap_backend_add_region(void *base, size_t size);
+/*
+ * Smallest region that, once added, is sure to satisfy an allocation of size
+ * bytes at align (0 for the natural 8), counting headers and bin rounding.
+ */
+size_t heap_backend_region_size(size_t size, size_t align);
+void *heap_backend_alloc(size_t size);
+/* align is a power of two above 8. */
+void *heap_backend_alloc_aligned(size_t size, size_t align);
+/* Grows or shrinks a live block without moving it; -1 if it cannot. */
+int heap_backend_resize(void *ptr, size_t size);
+/* Payload size of a live block, which can exceed what was asked for. */
+size_t heap_backend_block_size(const void *ptr);
+/* Returns the payload size released, 0 for a block that was already free. */
+size_t heap_backend_free(void *ptr);
+/*
+ * Fills the byte and block counts from running totals, without walking the
+ * heap; heap_get_stats derives the percentages.
+ */
+void heap_backend_stats(heap_stats_t *out);
+
+#endif
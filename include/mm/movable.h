@@ -0,0 +1,46 @@
+#ifndef MM_MOVABLE_H
+#define MM_MOVABLE_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+/*
+ * Relocatable buffers reached through handles. They live in a zone built
+ * from single pages, so small long-lived buffers never pin down heap blocks.
+ * The compactor slides them together at idle and hands the emptied pages
+ * back to the page allocator, where heap growth and arenas pick them up.
+ * A pointer from movable_pin stays valid until the matching movable_unpin;
+ * pin only briefly. No buffer can be larger than a page less its header.
+ */
+typedef uint32_t movable_t;
+
+#define MOVABLE_NONE 0u
+#define MOVABLE_MAX_SEGMENTS 32
+#define MOVABLE_HANDLES 256
+
+typedef struct
+{
+  size_t zone_bytes;
+  size_t used_bytes;
+  size_t hole_bytes;
+  size_t tail_free;
+  size_t handles;
+  uint32_t moves;
+  uint32_t passes;
+} movable_stats_t;
+
+int movable_init(void);
+movable_t movable_alloc(size_t size);
+/* Allocates a buffer holding a copy of size bytes from data. */
+movable_t movable_store(const void *data, size_t size);
+void movable_free(movable_t handle);
+void *movable_pin(movable_t handle);
+void movable_unpin(movable_t handle);
+size_t movable_size(movable_t handle);
+/* Copies up to max bytes out; returns how many were copied. */
+size_t movable_read(movable_t handle, void *out, size_t max);
+/* Moves up to budget bytes; returns 1 while there is compaction left to do. */
+int movable_compact_step(size_t budget);
+void movable_get_stats(movable_stats_t *out);
+
+#endif
@@ -0,0 +1,29 @@
+#ifndef MM_PAGE_H
+#define MM_PAGE_H
+
+#include <stddef.h>
+#include <stdint.h>
+#include "arch/e820.h"
+
+#define PAGE_SIZE 4096u
+#define PAGE_SHIFT 12
+/* Largest block is 2^PAGE_MAX_ORDER pages (4 MiB). */
+#define PAGE_MAX_ORDER 10
+
+typedef uint32_t phys_addr_t;
+
+typedef struct
+{
+  size_t total_pages;
+  size_t free_pages;
+  size_t free_blocks[PAGE_MAX_ORDER + 1];
+} page_stats_t;
+
+/* Hands usable RAM above 1 MiB to the buddy allocator; -1 without a map. */
+int page_init(const e820_map_t *map);
+/* 2^order contiguous, naturally aligned frames; 0 when none are free. */
+phys_addr_t page_alloc(unsigned order);
+void page_free(phys_addr_t addr, unsigned order);
+void page_get_stats(page_stats_t *out);
+
+#endif
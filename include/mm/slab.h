@@ -0,0 +1,28 @@
+#ifndef MM_SLAB_H
+#define MM_SLAB_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+/* Power-of-two size classes from 16 to 512 bytes, one page per slab. */
+#define SLAB_MIN_SIZE 16u
+#define SLAB_MAX_SIZE 512u
+#define SLAB_CLASS_COUNT 6
+
+typedef struct
+{
+  size_t object_size;
+  size_t slabs;
+  size_t objects_used;
+  size_t objects_total;
+} slab_cache_stats_t;
+
+void slab_init(void);
+/* O(1) allocation from the smallest class that fits; 0 above SLAB_MAX_SIZE or out of pages. */
+void *slab_alloc(size_t size);
+/* Returns the object size released, 0 if ptr was not a live slab object. */
+size_t slab_free(void *ptr);
+size_t slab_object_size(const void *ptr);
+int slab_cache_stats(size_t index, slab_cache_stats_t *out);
+
+#endif
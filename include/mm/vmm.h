@@ -0,0 +1,49 @@
+#ifndef MM_VMM_H
+#define MM_VMM_H
+
+#include <stddef.h>
+#include <stdint.h>
+#include "mm/page.h"
+
+/*
+ * Kernel address space: physical memory is mapped with 4 MiB pages at
+ * KERNEL_VIRT_BASE (the kernel image included), and the low 4 MiB is also
+ * identity-mapped until the APs are up. Everything from VMM_DYNAMIC_BASE
+ * up is mapped on demand with 4 KiB pages.
+ */
+#define KERNEL_VIRT_BASE 0xC0000000u
+#define VMM_DIRECT_MAP_SIZE 0x30000000u
+#define VMM_DYNAMIC_BASE (KERNEL_VIRT_BASE + VMM_DIRECT_MAP_SIZE)
+#define VMM_LARGE_PAGE_SIZE 0x400000u
+/* Process stacks get a window of their own; device windows stay below it. */
+#define VMM_STACK_BASE 0xFE000000u
+#define VMM_STACK_SIZE 0x01000000u
+
+/* Built by kernel_entry before paging is switched on; shared by every CPU. */
+extern uint32_t boot_page_directory[1024];
+
+#define VMM_WRITE 0x002u
+#define VMM_NOCACHE 0x018u
+
+static inline void *phys_to_virt(phys_addr_t addr)
+{
+  return (void *)((uintptr_t)addr + KERNEL_VIRT_BASE);
+}
+
+static inline phys_addr_t virt_to_phys(const void *addr)
+{
+  return (phys_addr_t)((uintptr_t)addr - KERNEL_VIRT_BASE);
+}
+
+/* Maps one 4 KiB page; -1 if virt lies in a large mapping or no table frame is free. */
+int vmm_map(uintptr_t virt, phys_addr_t phys, uint32_t flags);
+/* Unmaps one 4 KiB page and invalidates it on every CPU. */
+int vmm_unmap(uintptr_t virt);
+/* Physical address behind virt, or 0 if it is not mapped. */
+phys_addr_t vmm_translate(uintptr_t virt);
+/* Maps an uncached device window below the stack window; 0 on failure. */
+void *vmm_map_mmio(phys_addr_t phys, size_t size);
+/* Drops the boot identity map once nothing runs at physical addresses. */
+void vmm_drop_identity(void);
+
+#endif
@@ -4,16 +4,81 @@
 #include <stddef.h>
 #include <stdint.h>
 
+/* Time slice in timer ticks before the running process is preempted. */
+#define PROCESS_DEFAULT_TIMESLICE 10
+
+/* Lower numbers run first; equal priorities share the CPU round-robin. */
+#define PROCESS_PRIORITIES 8
+#define PROCESS_PRIO_HIGH 1
+#define PROCESS_PRIO_INTERACTIVE 2
+#define PROCESS_PRIO_DEFAULT 4
+
+typedef enum
+{
+  PROCESS_RUNNABLE = 0,
+  PROCESS_BLOCKED,
+  PROCESS_SLEEPING
+} process_state_t;
+
+struct process;
+
+typedef struct
+{
+  uint32_t pid;
+  uint64_t run_ns;
+  uint64_t wait_ns;
+  uint64_t switches;
+  uint64_t voluntary_switches;
+  uint64_t involuntary_switches;
+  size_t stack_size;
+  size_t stack_used;
+  size_t arena_used;
+  size_t arena_reserved;
+} process_stats_t;
+
+#define PROCESS_NAME_MAX 16
+
+/* Copied out under the scheduler lock, so it outlives the process. */
+typedef struct
+{
+  char name[PROCESS_NAME_MAX];
+  process_state_t state;
+  uint8_t priority;
+  uint8_t active;
+  uint8_t kill_requested;
+  process_stats_t stats;
+} process_info_t;
+
 void process_init(void);
 int process_create(const char *name, void (*entry)(void *), void *arg, size_t stack_size);
 void process_yield(void);
+struct process *process_self(void);
+uint32_t process_current_pid(void);
+void process_sleep_ms(uint32_t ms);
+/*
+ * Allocates from the calling process's arena. There is no matching free:
+ * the whole arena goes back in one step when the process exits or is killed.
+ */
+void *process_alloc(size_t size);
+void process_idle_stats(uint64_t *idle_ticks, uint64_t *total_ticks);
+void process_timer_tick(void);
+/* Reschedule IPI: preempt if a wakeup flagged this CPU. */
+void process_reschedule(void);
+/*
+ * #NM handler: gives the FPU/SSE registers to the running process, loading
+ * its saved state. Returns -1 if lazy switching is off or state can't be kept.
+ */
+int process_fpu_trap(void);
+/* Entry point for an application processor; becomes its idle loop. */
+void process_ap_start(uint32_t cpu_index);
+void process_set_timeslice(uint32_t ticks);
+uint32_t process_get_timeslice(void);
+int process_set_priority(uint32_t pid, uint8_t priority);
 void process_run(void);
 size_t process_count(void);
-int process_is_used(size_t index);
-const char *process_name(size_t index);
-int process_is_active(size_t index);
-int process_is_kill_requested(size_t index);
-uint32_t process_pid(size_t index);
+/* Fills info for the process in table slot index; -1 if the slot is empty. */
+int process_snapshot(size_t index, process_info_t *info);
+uint32_t process_find(const char *name);
 int process_kill(uint32_t pid, int force);
 uint64_t process_get_ticks(void);
 
@@ -0,0 +1,48 @@
+#ifndef PROC_STACK_H
+#define PROC_STACK_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+/*
+ * Process stacks are recycled through per-size freelists (2 KiB, 4 KiB and
+ * a short list of larger stacks) instead of going back to the heap on every
+ * exit, so spawning a process does not walk the heap and restarting services
+ * does not fragment it.
+ */
+#define STACK_POOL_SMALL 2048u
+#define STACK_POOL_MEDIUM 4096u
+#define STACK_POOL_CACHE_MAX 4
+
+/*
+ * Stacks are painted with a canary at spawn. The lowest words act as a soft
+ * guard region checked at every context switch; how much paint survives
+ * gives the high-water mark. Stacks up to 60 KiB are also mapped just above
+ * an unmapped page, so an overflow faults at once instead of running into
+ * the heap. With no double-fault stack that fault resets the machine rather
+ * than panicking. A stack that has to come from the heap has only the canary.
+ */
+#define STACK_CANARY 0x5AC4CA11u
+#define STACK_GUARD_BYTES 32u
+
+typedef struct
+{
+  size_t cached[3];
+  size_t hits;
+  size_t misses;
+} stack_pool_stats_t;
+
+void stack_pool_init(void);
+/* Returns the stack base; *size is rounded up to the pooled size. */
+uint8_t *stack_pool_alloc(size_t *size);
+void stack_pool_free(uint8_t *base, size_t size);
+/* Unmaps stacks a full cache turned away. Call with no lock held: it waits on every CPU. */
+void stack_pool_reclaim(void);
+void stack_pool_get_stats(stack_pool_stats_t *out);
+
+void stack_paint(uint8_t *base, size_t size);
+int stack_guard_intact(const uint8_t *base);
+/* Bytes of the stack ever touched, counted down from the top. */
+size_t stack_high_water(const uint8_t *base, size_t size);
+
+#endif
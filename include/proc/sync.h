@@ -0,0 +1,43 @@
+#ifndef PROC_SYNC_H
+#define PROC_SYNC_H
+
+#include <stdint.h>
+#include "proc/wait.h"
+
+struct process;
+
+typedef struct
+{
+  int locked;
+  struct process *owner;
+  wait_queue_t waiters;
+} mutex_t;
+
+typedef struct
+{
+  int count;
+  wait_queue_t waiters;
+} semaphore_t;
+
+typedef struct
+{
+  wait_queue_t waiters;
+} condvar_t;
+
+void mutex_init(mutex_t *mutex);
+void mutex_lock(mutex_t *mutex);
+int mutex_trylock(mutex_t *mutex);
+void mutex_unlock(mutex_t *mutex);
+
+void semaphore_init(semaphore_t *sem, int count);
+void semaphore_wait(semaphore_t *sem);
+int semaphore_trywait(semaphore_t *sem);
+void semaphore_post(semaphore_t *sem);
+
+void condvar_init(condvar_t *cv);
+/* Atomically releases mutex and waits; the mutex is held again on return. */
+void condvar_wait(condvar_t *cv, mutex_t *mutex);
+void condvar_signal(condvar_t *cv);
+void condvar_broadcast(condvar_t *cv);
+
+#endif
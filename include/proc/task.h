@@ -0,0 +1,89 @@
+#ifndef PROC_TASK_H
+#define PROC_TASK_H
+
+#include <stddef.h>
+#include <stdint.h>
+#include "sys/timer.h"
+
+/*
+ * Stackless tasks: a poll function that runs to its next await point and
+ * returns, keeping its resume point in the task itself. All tasks share the
+ * one "tasks" executor process, so a task costs only its task_t. Locals do
+ * not survive an await; keep state in the task's arg.
+ *
+ * Task records must start zeroed (static storage) or be reused only after
+ * task_cancel.
+ */
+
+#define TASK_WAITING 0 /* parked until its timer fires or task_wake */
+#define TASK_YIELDED 1 /* polled again after the other ready tasks */
+#define TASK_DONE 2
+
+struct task;
+typedef int (*task_fn_t)(struct task *task);
+
+typedef struct task
+{
+  struct task *next;
+  struct task *all_next;
+  task_fn_t fn;
+  void *arg;
+  const char *name;
+  ktimer_t timer;
+  uint16_t resume;
+  uint8_t queued;
+  uint8_t active;
+} task_t;
+
+#define TASK_BEGIN(t)      \
+  switch ((t)->resume)     \
+  {                        \
+  case 0:
+
+#define TASK_END(t)        \
+  }                        \
+  (t)->resume = 0;         \
+  return TASK_DONE
+
+#define TASK_YIELD(t)              \
+  do                               \
+  {                                \
+    (t)->resume = __LINE__;        \
+    return TASK_YIELDED;           \
+  case __LINE__:;                  \
+  } while (0)
+
+#define TASK_SLEEP_MS(t, ms)       \
+  do                               \
+  {                                \
+    (t)->resume = __LINE__;        \
+    task_sleep_ms((t), (ms));      \
+    return TASK_WAITING;           \
+  case __LINE__:;                  \
+  } while (0)
+
+/* Whoever makes cond true must task_wake the task. */
+#define TASK_AWAIT(t, cond)              \
+  do                                     \
+  {                                      \
+    (t)->resume = __LINE__;              \
+    __attribute__((fallthrough));        \
+  case __LINE__:                         \
+    if (!(cond))                         \
+    {                                    \
+      return TASK_WAITING;               \
+    }                                    \
+  } while (0)
+
+int task_executor_init(void);
+void task_spawn(task_t *task, const char *name, task_fn_t fn, void *arg);
+void task_cancel(task_t *task);
+/* Safe from interrupt handlers and timer callbacks. */
+void task_wake(task_t *task);
+void task_sleep_ms(task_t *task, uint32_t ms);
+
+size_t task_count(void);
+/* Fills names/ready flags of up to max tasks; returns how many. */
+size_t task_list(const char **names, int *ready, size_t max);
+
+#endif
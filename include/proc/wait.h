@@ -0,0 +1,67 @@
+#ifndef PROC_WAIT_H
+#define PROC_WAIT_H
+
+#include <stdint.h>
+
+struct process;
+
+/*
+ * FIFO of blocked processes. The links live in the waiting process itself,
+ * so queueing needs no allocation and a blocked process costs nothing in
+ * the scheduler's pick-next scan.
+ */
+typedef struct wait_queue
+{
+  struct process *head;
+  struct process *tail;
+} wait_queue_t;
+
+#define WAIT_QUEUE_INIT {0, 0}
+
+/*
+ * The scheduler lock guards every wait queue. It nests on one CPU and
+ * disables interrupts; the returned flags restore them on the final unlock.
+ */
+uint32_t sched_lock(void);
+void sched_unlock(uint32_t flags);
+
+void wait_queue_init(wait_queue_t *wq);
+
+/*
+ * Blocks the caller on wq. Must be called with the scheduler lock held so
+ * the waker cannot slip in between the condition check and the enqueue.
+ * Returns 0 when woken by wake_up, -1 on timeout or kill request.
+ * A timeout_ms of 0 waits forever.
+ */
+int wait_queue_sleep(wait_queue_t *wq, uint32_t timeout_ms);
+
+/* Safe from interrupt handlers. Return the number of processes woken. */
+int wake_up_one(wait_queue_t *wq);
+int wake_up(wait_queue_t *wq);
+
+#define wait_event(wq, cond)                 \
+  do                                         \
+  {                                          \
+    uint32_t wait_flags_ = sched_lock();     \
+    while (!(cond))                          \
+    {                                        \
+      (void)wait_queue_sleep(&(wq), 0);      \
+    }                                        \
+    sched_unlock(wait_flags_);               \
+  } while (0)
+
+/* Waits at most once for timeout_ms; evaluates to the final condition. */
+#define wait_event_timeout(wq, cond, timeout_ms)       \
+  ({                                                   \
+    uint32_t wait_flags_ = sched_lock();               \
+    int wait_ok_ = (cond) != 0;                        \
+    if (!wait_ok_)                                     \
+    {                                                  \
+      (void)wait_queue_sleep(&(wq), (timeout_ms));     \
+      wait_ok_ = (cond) != 0;                          \
+    }                                                  \
+    sched_unlock(wait_flags_);                         \
+    wait_ok_;                                          \
+  })
+
+#endif
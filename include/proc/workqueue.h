@@ -0,0 +1,30 @@
+#ifndef PROC_WORKQUEUE_H
+#define PROC_WORKQUEUE_H
+
+#include <stddef.h>
+
+typedef void (*work_fn_t)(void *arg);
+
+/*
+ * Deferred work item, run later in process context by a kworker. The link
+ * lives in the item, so queueing never allocates and is safe from interrupt
+ * handlers and from inside the scheduler. A pending item is not queued twice.
+ */
+typedef struct work
+{
+  struct work *next;
+  work_fn_t fn;
+  void *arg;
+  int pending;
+} work_t;
+
+#define WORKQUEUE_MAX_WORKERS 4
+
+void work_init(work_t *work, work_fn_t fn, void *arg);
+/* Starts one worker per CPU, up to WORKQUEUE_MAX_WORKERS. */
+int workqueue_init(void);
+/* Returns 0 if queued, -1 if the item was already pending. */
+int queue_work(work_t *work);
+size_t workqueue_pending(void);
+
+#endif
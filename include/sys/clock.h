@@ -0,0 +1,29 @@
+#ifndef SYS_CLOCK_H
+#define SYS_CLOCK_H
+
+#include <stdint.h>
+
+#define CLOCK_NS_PER_MS 1000000u
+#define CLOCK_NS_PER_SEC 1000000000u
+
+typedef struct
+{
+  uint16_t year;
+  uint8_t month;
+  uint8_t day;
+  uint8_t hour;
+  uint8_t minute;
+  uint8_t second;
+} clock_datetime_t;
+
+void clock_init(void);
+uint64_t clock_ns(void);
+/* Raw, cheap timestamp for accounting: TSC cycles, or ns without a TSC. */
+uint64_t clock_cycles(void);
+uint64_t clock_cycles_to_ns(uint64_t cycles);
+uint64_t clock_ms(void);
+uint32_t clock_tsc_khz(void);
+uint64_t clock_epoch_seconds(void);
+void clock_datetime(clock_datetime_t *out);
+
+#endif
@@ -11,7 +11,7 @@ typedef enum {
 
 typedef struct {
   uint64_t seq;
-  uint64_t tick;
+  uint64_t time_ns;
   uint8_t level;
   char msg[64];
 } log_entry_t;
@@ -25,5 +25,7 @@ void log_error(const char *msg);
 uint64_t log_oldest_seq(void);
 uint64_t log_latest_seq(void);
 int log_read(uint64_t seq, log_entry_t *out);
+/* Blocks until entry seq exists or timeout_ms passes; returns 1 if it exists. */
+int log_wait(uint64_t seq, uint32_t timeout_ms);
 
 #endif
@@ -0,0 +1,30 @@
+#ifndef SYS_TIMER_H
+#define SYS_TIMER_H
+
+#include <stdint.h>
+
+typedef void (*timer_fn_t)(void *arg);
+
+/*
+ * One-shot kernel timer. Callbacks run from the timer interrupt with
+ * interrupts disabled, so they must be short and must not block.
+ */
+typedef struct ktimer
+{
+  struct ktimer *next;
+  struct ktimer **pprev;
+  uint64_t expires;
+  timer_fn_t fn;
+  void *arg;
+} ktimer_t;
+
+void timer_init(void);
+void timer_setup(ktimer_t *timer, timer_fn_t fn, void *arg);
+void timer_start(ktimer_t *timer, uint32_t ms);
+int timer_cancel(ktimer_t *timer);
+int timer_pending(const ktimer_t *timer);
+void timer_tick(void);
+uint64_t timer_ticks(void);
+uint32_t timer_ms_to_ticks(uint32_t ms);
+
+#endif
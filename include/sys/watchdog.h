@@ -3,10 +3,15 @@
 
 #include <stdint.h>
 
+struct task;
+
 void watchdog_kick(void);
 void watchdog_reset(void);
 uint64_t watchdog_last_kick(void);
-uint64_t watchdog_timeout_ticks(void);
-void watchdog_process(void *arg);
+uint64_t watchdog_timeout_ns(void);
+/* Runs as a stackless task on the task executor. */
+int watchdog_task(struct task *task);
+/* False once the check has not run for ten periods. */
+int watchdog_healthy(void);
 
 #endif
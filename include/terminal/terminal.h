@@ -8,8 +8,10 @@ void terminal_clear(void);
 void terminal_write(const char *str);
 void terminal_writeln(const char *str);
 size_t terminal_readline(char *buffer, size_t max_len);
+/* Copies history entry index (0 is the oldest) into out; returns its length. */
+typedef size_t (*terminal_history_fn)(size_t index, char *out, size_t out_len);
 size_t terminal_readline_history(char *buffer, size_t max_len,
-                                 const char **history, size_t history_len,
+                                 terminal_history_fn history, size_t history_len,
                                  size_t *history_pos,
                                  char *scratch, size_t scratch_len);
 
@@ -1,5 +1,11 @@
+#include "arch/cpu.h"
+#include "arch/smp.h"
+#include "arch/gdt.h"
+#include "arch/idt.h"
 #include "drivers/driver.h"
 #include "sys/init.h"
+#include "sys/clock.h"
+#include "sys/timer.h"
 #include "sys/log.h"
 #include "sys/panic.h"
 #include "sys/power.h"
@@ -7,13 +13,21 @@
 #include "terminal/terminal.h"
 #include "shell/shell.h"
 #include "mm/heap.h"
+#include "mm/page.h"
+#include "mm/vmm.h"
+#include "mm/movable.h"
+#include "lib/string.h"
 #include "proc/process.h"
+#include "proc/wait.h"
+#include "proc/workqueue.h"
+#include "proc/task.h"
 #include "drivers/keyboard.h"
 
 #define KERNEL_HEAP_SIZE (64u * 1024u)
 
 static uint8_t kernel_heap[KERNEL_HEAP_SIZE];
 static volatile int init_done;
+static wait_queue_t init_wait = WAIT_QUEUE_INIT;
 
 typedef int (*kernel_module_fn)(void);
 
@@ -24,32 +38,21 @@ typedef struct
   kernel_module_fn start;
 } kernel_module_t;
 
-static int str_eq(const char *a, const char *b)
-{
-  while (*a && *b)
-  {
-    if (*a != *b)
-    {
-      return 0;
-    }
-    a++;
-    b++;
-  }
-  return *a == '\0' && *b == '\0';
-}
-
 void process_on_exit(const char *name)
 {
   services_on_process_exit(name);
   if (name && str_eq(name, "init"))
   {
     init_done = 1;
+    (void)wake_up(&init_wait);
   }
 }
 
 static void init_process(void *arg)
 {
   (void)arg;
+  /* init ends up running the shell, the tty's only reader. */
+  (void)process_set_priority(process_current_pid(), PROCESS_PRIO_INTERACTIVE);
   init_run();
   terminal_writeln("Init complete. Starting shell...");
   shell_run();
@@ -62,6 +65,26 @@ static int module_drivers_load(void)
   return 0;
 }
 
+static int module_workqueue_start(void)
+{
+  if (workqueue_init() != 0)
+  {
+    log_error("workqueue:worker start failed");
+    return -1;
+  }
+  return 0;
+}
+
+static int module_tasks_start(void)
+{
+  if (task_executor_init() != 0)
+  {
+    log_error("tasks:executor start failed");
+    return -1;
+  }
+  return 0;
+}
+
 static int module_services_load(void)
 {
   services_init();
@@ -111,15 +134,31 @@ static int run_kernel_modules(const kernel_module_t *modules, size_t count)
   return 0;
 }
 
-void kernel_main(void)
+void kernel_main(const e820_map_t *memory_map)
 {
+  gdt_init();
+  idt_init();
+  clock_init();
+  timer_init();
   heap_init(kernel_heap, KERNEL_HEAP_SIZE);
+  int pages_ok = page_init(memory_map) == 0;
+  movable_init();
   process_init();
+  string_init();
   log_init();
+  if (!pages_ok)
+  {
+    log_warn("mem:no usable E820 memory map");
+  }
+  smp_init();
+  /* The APs were the last code running at physical addresses. */
+  vmm_drop_identity();
 
   init_done = 0;
   kernel_module_t modules[] = {
       {"drivers", module_drivers_load, 0},
+      {"workqueue", 0, module_workqueue_start},
+      {"tasks", 0, module_tasks_start},
       {"services", module_services_load, module_services_start},
       {"init", 0, module_init_start},
   };
@@ -128,19 +167,12 @@ void kernel_main(void)
            "kernel module failure");
 
   terminal_writeln("Booting OS...");
+  cpu_irq_enable();
 
-  while (!init_done)
-  {
-    process_yield();
-  }
+  wait_event(init_wait, init_done);
 
   terminal_writeln("Shell exited.");
   terminal_writeln("Press any key to shut down.");
-  for (;;)
-  {
-    if (keyboard_poll_key() != 0)
-    {
-      power_shutdown();
-    }
-  }
+  (void)keyboard_read_key();
+  power_shutdown();
 }
@@ -2,11 +2,66 @@
 [section .text.entry]
 
 global _start
+global boot_page_directory
 extern kernel_main
+extern __bss_start
+extern __bss_end
+
+; The kernel is linked at KERNEL_VIRT_BASE but loaded at its physical
+; address, so until paging is on every absolute address is adjusted by hand.
+KERNEL_VIRT_BASE equ 0xC0000000
+KERNEL_PDE_INDEX equ KERNEL_VIRT_BASE >> 22
+DIRECT_MAP_PDES equ 192             ; 768 MiB in 4 MiB pages
+PDE_LARGE_RW equ 0x83               ; present, writable, 4 MiB
+CR0_PG equ 0x80000000
+CR4_PSE equ 0x10
 
 _start:
+    ; The loader only copies the file image; clear .bss ourselves.
+    cld
+    xor eax, eax
+    mov edi, __bss_start - KERNEL_VIRT_BASE
+    mov ecx, __bss_end - KERNEL_VIRT_BASE
+    sub ecx, edi
+    shr ecx, 2
+    rep stosd
+
+    ; Identity-map the low 4 MiB (we are running there) and map physical
+    ; memory at KERNEL_VIRT_BASE, all with 4 MiB pages.
+    mov edi, boot_page_directory - KERNEL_VIRT_BASE
+    mov dword [edi], PDE_LARGE_RW
+    lea esi, [edi + KERNEL_PDE_INDEX * 4]
+    mov eax, PDE_LARGE_RW
+    mov ecx, DIRECT_MAP_PDES
+.map:
+    mov [esi], eax
+    add eax, 0x400000
+    add esi, 4
+    loop .map
+
+    mov eax, cr4
+    or eax, CR4_PSE
+    mov cr4, eax
+    mov cr3, edi
+    mov eax, cr0
+    or eax, CR0_PG
+    mov cr0, eax
+    mov eax, .higher_half
+    jmp eax
+
+.higher_half:
+    ; Keep the boot stack, now through the direct map.
+    add esp, KERNEL_VIRT_BASE
+
+    ; The bootloader hands over the E820 memory map in EBX.
+    add ebx, KERNEL_VIRT_BASE
+    push ebx
     call kernel_main
 
 .hang:
     hlt
     jmp .hang
+
+section .bss align=4096
+boot_page_directory:
+    resb 4096
@@ -0,0 +1,89 @@
+[bits 16]
+
+global ap_trampoline_start
+global ap_trampoline_end
+global ap_boot_next
+global ap_boot_max
+global ap_boot_stacks
+global ap_boot_stack_size
+global ap_boot_cr3
+extern ap_main
+
+; smp_init copies this blob to AP_TRAMPOLINE_BASE, below 1 MiB where a
+; startup IPI can point, so everything inside it is addressed relative to
+; that copy. APs arrive in real mode, switch to the flat 32-bit segments,
+; turn on paging with the kernel's page directory (the low identity map
+; keeps the copy reachable), claim an index and a boot stack with one
+; atomic add, then call ap_main in the higher half.
+
+AP_TRAMPOLINE_BASE equ 0x8000
+%define AP_ADDR(label) (AP_TRAMPOLINE_BASE + ((label) - ap_trampoline_start))
+
+section .text
+ap_trampoline_start:
+    cli
+    cld
+    xor ax, ax
+    mov ds, ax
+    lgdt [AP_ADDR(ap_gdt_ptr)]
+    mov eax, cr0
+    or eax, 1
+    mov cr0, eax
+    jmp dword 0x08:AP_ADDR(ap_protected)
+
+[bits 32]
+ap_protected:
+    mov ax, 0x10
+    mov ds, ax
+    mov es, ax
+    mov fs, ax
+    mov gs, ax
+    mov ss, ax
+
+    mov eax, cr4
+    or eax, 0x10                        ; PSE
+    mov cr4, eax
+    mov eax, [AP_ADDR(ap_boot_cr3)]
+    mov cr3, eax
+    mov eax, cr0
+    or eax, 0x80000000                  ; PG
+    mov cr0, eax
+
+    ; CPU index = arrival order + 1; the boot CPU is 0.
+    mov eax, 1
+    lock xadd [ap_boot_next], eax
+    inc eax
+    cmp eax, [ap_boot_max]
+    jae .park
+
+    mov ecx, eax
+    imul ecx, [ap_boot_stack_size]
+    add ecx, [ap_boot_stacks]
+    mov esp, ecx
+    push eax
+    mov eax, ap_main
+    call eax
+
+.park:
+    cli
+    hlt
+    jmp .park
+
+align 8
+ap_gdt:
+    dq 0x0000000000000000
+    dq 0x00CF9A000000FFFF
+    dq 0x00CF92000000FFFF
+ap_gdt_ptr:
+    dw ap_gdt_ptr - ap_gdt - 1
+    dd AP_ADDR(ap_gdt)
+; Physical address of the page directory, patched by smp_init before the copy.
+ap_boot_cr3:
+    dd 0
+ap_trampoline_end:
+
+section .data
+ap_boot_next:       dd 0
+ap_boot_max:        dd 0
+ap_boot_stacks:     dd 0
+ap_boot_stack_size: dd 0
@@ -0,0 +1,171 @@
+#include "arch/cpu.h"
+
+#define EFLAGS_IF 0x200u
+#define CPUID_EDX_TSC (1u << 4)
+#define CPUID_EDX_FXSR (1u << 24)
+#define CPUID_EDX_SSE (1u << 25)
+#define CPUID_EDX_SSE2 (1u << 26)
+#define CR0_MP (1u << 1)
+#define CR0_EM (1u << 2)
+#define CR0_TS (1u << 3)
+#define CR0_NE (1u << 5)
+#define CR4_OSFXSR (1u << 9)
+#define CR4_OSXMMEXCPT (1u << 10)
+#define MXCSR_DEFAULT 0x1F80u
+
+void cpu_irq_enable(void)
+{
+  __asm__ __volatile__("sti" : : : "memory");
+}
+
+void cpu_irq_disable(void)
+{
+  __asm__ __volatile__("cli" : : : "memory");
+}
+
+uint32_t cpu_irq_save(void)
+{
+  uint32_t flags;
+  __asm__ __volatile__("pushfl\n\tpopl %0\n\tcli" : "=r"(flags) : : "memory");
+  return flags;
+}
+
+void cpu_irq_restore(uint32_t flags)
+{
+  if (flags & EFLAGS_IF)
+  {
+    cpu_irq_enable();
+  }
+}
+
+int cpu_irq_enabled(void)
+{
+  uint32_t flags;
+  __asm__ __volatile__("pushfl\n\tpopl %0" : "=r"(flags));
+  return (flags & EFLAGS_IF) != 0;
+}
+
+void cpu_halt(void)
+{
+  __asm__ __volatile__("hlt" : : : "memory");
+}
+
+void cpu_idle(void)
+{
+  /* STI only takes effect after the next instruction, so no wakeup is lost. */
+  __asm__ __volatile__("sti\n\thlt\n\tcli" : : : "memory");
+}
+
+void cpu_cpuid(uint32_t leaf, uint32_t *eax, uint32_t *ebx, uint32_t *ecx, uint32_t *edx)
+{
+  uint32_t a, b, c, d;
+  __asm__ __volatile__("cpuid" : "=a"(a), "=b"(b), "=c"(c), "=d"(d) : "a"(leaf), "c"(0));
+  if (eax)
+  {
+    *eax = a;
+  }
+  if (ebx)
+  {
+    *ebx = b;
+  }
+  if (ecx)
+  {
+    *ecx = c;
+  }
+  if (edx)
+  {
+    *edx = d;
+  }
+}
+
+uint64_t cpu_rdtsc(void)
+{
+  uint32_t lo, hi;
+  __asm__ __volatile__("rdtsc" : "=a"(lo), "=d"(hi));
+  return ((uint64_t)hi << 32) | lo;
+}
+
+int cpu_has_tsc(void)
+{
+  uint32_t edx = 0;
+  cpu_cpuid(1, 0, 0, 0, &edx);
+  return (edx & CPUID_EDX_TSC) != 0;
+}
+
+int cpu_has_sse2(void)
+{
+  uint32_t edx = 0;
+  cpu_cpuid(1, 0, 0, 0, &edx);
+  return (edx & CPUID_EDX_SSE2) != 0;
+}
+
+uint64_t cpu_rdmsr(uint32_t msr)
+{
+  uint32_t lo, hi;
+  __asm__ __volatile__("rdmsr" : "=a"(lo), "=d"(hi) : "c"(msr));
+  return ((uint64_t)hi << 32) | lo;
+}
+
+void cpu_wrmsr(uint32_t msr, uint64_t value)
+{
+  __asm__ __volatile__("wrmsr" : : "c"(msr), "a"((uint32_t)value), "d"((uint32_t)(value >> 32)));
+}
+
+int cpu_fpu_init(void)
+{
+  uint32_t edx = 0;
+  cpu_cpuid(1, 0, 0, 0, &edx);
+  if ((edx & (CPUID_EDX_FXSR | CPUID_EDX_SSE)) != (CPUID_EDX_FXSR | CPUID_EDX_SSE))
+  {
+    return -1;
+  }
+
+  uint32_t cr0, cr4;
+  __asm__ __volatile__("mov %%cr0, %0" : "=r"(cr0));
+  cr0 &= ~CR0_EM;
+  cr0 |= CR0_MP | CR0_NE;
+  __asm__ __volatile__("mov %0, %%cr0" : : "r"(cr0) : "memory");
+  __asm__ __volatile__("mov %%cr4, %0" : "=r"(cr4));
+  cr4 |= CR4_OSFXSR | CR4_OSXMMEXCPT;
+  __asm__ __volatile__("mov %0, %%cr4" : : "r"(cr4) : "memory");
+  cpu_fpu_reset();
+  return 0;
+}
+
+int cpu_fpu_enabled(void)
+{
+  uint32_t cr4;
+  __asm__ __volatile__("mov %%cr4, %0" : "=r"(cr4));
+  return (cr4 & CR4_OSFXSR) != 0;
+}
+
+void cpu_fpu_trap_next(void)
+{
+  uint32_t cr0;
+  __asm__ __volatile__("mov %%cr0, %0" : "=r"(cr0));
+  if (!(cr0 & CR0_TS))
+  {
+    __asm__ __volatile__("mov %0, %%cr0" : : "r"(cr0 | CR0_TS) : "memory");
+  }
+}
+
+void cpu_fpu_allow(void)
+{
+  __asm__ __volatile__("clts" : : : "memory");
+}
+
+void cpu_fpu_reset(void)
+{
+  uint32_t mxcsr = MXCSR_DEFAULT;
+  __asm__ __volatile__("fninit\n\tldmxcsr %0" : : "m"(mxcsr) : "memory");
+}
+
+void cpu_fxsave(void *area)
+{
+  __asm__ __volatile__("fxsave (%0)" : : "r"(area) : "memory");
+}
+
+void cpu_fxrstor(const void *area)
+{
+  __asm__ __volatile__("fxrstor (%0)" : : "r"(area) : "memory");
+}
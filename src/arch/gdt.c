@@ -0,0 +1,41 @@
+#include "arch/gdt.h"
+#include <stdint.h>
+
+/*
+ * The bootloader's GDT lives inside the boot sector, which the kernel image
+ * and heap later overwrite. Interrupt returns reload CS/SS from the GDT, so
+ * keep an identical flat table in kernel memory.
+ */
+
+typedef struct
+{
+  uint16_t limit;
+  uint32_t base;
+} __attribute__((packed)) gdt_ptr_t;
+
+static const uint64_t gdt_table[] = {
+    0x0000000000000000ull,
+    0x00CF9A000000FFFFull,
+    0x00CF92000000FFFFull,
+};
+
+void gdt_init(void)
+{
+  gdt_ptr_t ptr;
+  ptr.limit = (uint16_t)(sizeof(gdt_table) - 1);
+  ptr.base = (uint32_t)(uintptr_t)gdt_table;
+
+  __asm__ __volatile__(
+      "lgdt %0\n\t"
+      "ljmp %1, $1f\n"
+      "1:\n\t"
+      "movw %2, %%ax\n\t"
+      "movw %%ax, %%ds\n\t"
+      "movw %%ax, %%es\n\t"
+      "movw %%ax, %%fs\n\t"
+      "movw %%ax, %%gs\n\t"
+      "movw %%ax, %%ss\n\t"
+      :
+      : "m"(ptr), "i"(GDT_KERNEL_CODE), "i"(GDT_KERNEL_DATA)
+      : "eax", "memory");
+}
@@ -0,0 +1,160 @@
+#include "arch/idt.h"
+#include "arch/gdt.h"
+#include "arch/pic.h"
+#include "arch/lapic.h"
+#include "sys/panic.h"
+#include "proc/process.h"
+
+#define IDT_ENTRIES 256
+#define IDT_STUB_COUNT (IDT_EXCEPTION_COUNT + PIC_IRQ_COUNT + IDT_IPI_COUNT)
+#define IDT_GATE_INT32 0x8E
+#define IDT_VECTOR_NM 7
+
+typedef struct
+{
+  uint16_t offset_low;
+  uint16_t selector;
+  uint8_t zero;
+  uint8_t type_attr;
+  uint16_t offset_high;
+} __attribute__((packed)) idt_entry_t;
+
+typedef struct
+{
+  uint16_t limit;
+  uint32_t base;
+} __attribute__((packed)) idt_ptr_t;
+
+extern uint32_t isr_stub_table[IDT_STUB_COUNT];
+extern void isr_stub_spurious(void);
+
+static idt_entry_t idt[IDT_ENTRIES];
+static irq_handler_t irq_handlers[PIC_IRQ_COUNT];
+static irq_handler_t ipi_handlers[IDT_IPI_COUNT];
+
+static const char *const exception_names[IDT_EXCEPTION_COUNT] = {
+    "divide error",
+    "debug",
+    "non-maskable interrupt",
+    "breakpoint",
+    "overflow",
+    "bound range exceeded",
+    "invalid opcode",
+    "device not available",
+    "double fault",
+    "coprocessor segment overrun",
+    "invalid tss",
+    "segment not present",
+    "stack-segment fault",
+    "general protection fault",
+    "page fault",
+    "reserved exception",
+    "x87 floating-point error",
+    "alignment check",
+    "machine check",
+    "simd floating-point error",
+    "virtualization exception",
+    "control protection exception",
+    "reserved exception",
+    "reserved exception",
+    "reserved exception",
+    "reserved exception",
+    "reserved exception",
+    "reserved exception",
+    "hypervisor injection exception",
+    "vmm communication exception",
+    "security exception",
+    "reserved exception",
+};
+
+static void idt_set_gate(uint8_t vector, uint32_t handler)
+{
+  idt[vector].offset_low = (uint16_t)(handler & 0xFFFF);
+  idt[vector].selector = GDT_KERNEL_CODE;
+  idt[vector].zero = 0;
+  idt[vector].type_attr = IDT_GATE_INT32;
+  idt[vector].offset_high = (uint16_t)((handler >> 16) & 0xFFFF);
+}
+
+void idt_init(void)
+{
+  for (uint32_t i = 0; i < IDT_STUB_COUNT; ++i)
+  {
+    idt_set_gate((uint8_t)i, isr_stub_table[i]);
+  }
+  idt_set_gate(LAPIC_SPURIOUS_VECTOR, (uint32_t)(uintptr_t)isr_stub_spurious);
+
+  pic_init();
+  idt_load();
+}
+
+void idt_load(void)
+{
+  idt_ptr_t ptr;
+  ptr.limit = (uint16_t)(sizeof(idt) - 1);
+  ptr.base = (uint32_t)(uintptr_t)idt;
+  __asm__ __volatile__("lidt %0" : : "m"(ptr) : "memory");
+}
+
+int irq_register(uint8_t irq, irq_handler_t handler)
+{
+  if (irq >= PIC_IRQ_COUNT || !handler)
+  {
+    return -1;
+  }
+  irq_handlers[irq] = handler;
+  pic_unmask(irq);
+  return 0;
+}
+
+int ipi_register(uint8_t vector, irq_handler_t handler)
+{
+  if (vector < IDT_IPI_BASE || vector >= IDT_IPI_BASE + IDT_IPI_COUNT || !handler)
+  {
+    return -1;
+  }
+  ipi_handlers[vector - IDT_IPI_BASE] = handler;
+  return 0;
+}
+
+void isr_dispatch(interrupt_frame_t *frame)
+{
+  if (frame->vector < IDT_EXCEPTION_COUNT)
+  {
+    /* Device-not-available is how lazy FPU switching hands over the FPU. */
+    if (frame->vector == IDT_VECTOR_NM && process_fpu_trap() == 0)
+    {
+      return;
+    }
+    panic(exception_names[frame->vector]);
+    return;
+  }
+
+  if (frame->vector >= IDT_IPI_BASE)
+  {
+    /* Same ordering as below: the handler may switch processes. */
+    lapic_eoi();
+    irq_handler_t handler = ipi_handlers[frame->vector - IDT_IPI_BASE];
+    if (handler)
+    {
+      handler(frame);
+    }
+    return;
+  }
+
+  uint8_t irq = (uint8_t)(frame->vector - PIC_IRQ_BASE);
+  if (irq >= PIC_IRQ_COUNT || pic_is_spurious(irq))
+  {
+    return;
+  }
+
+  /*
+   * Acknowledge before running the handler: the timer handler may switch to
+   * another process and not come back here for a whole time slice.
+   */
+  pic_send_eoi(irq);
+  if (irq_handlers[irq])
+  {
+    irq_handlers[irq](frame);
+  }
+}
@@ -0,0 +1,101 @@
+[bits 32]
+
+global isr_stub_table
+global isr_stub_spurious
+extern isr_dispatch
+
+; CPU exceptions 0-31 followed by remapped PIC IRQs 0-15 (vectors 32-47)
+; and the inter-processor interrupts (vectors 48-51).
+; Every stub leaves the same layout on the stack: error code (0 when the CPU
+; does not push one) and vector number, then the common path adds PUSHA and
+; hands isr_dispatch a pointer to the resulting interrupt_frame_t.
+
+%macro ISR_NOERR 1
+isr_stub_%1:
+    push dword 0
+    push dword %1
+    jmp isr_common
+%endmacro
+
+%macro ISR_ERR 1
+isr_stub_%1:
+    push dword %1
+    jmp isr_common
+%endmacro
+
+ISR_NOERR 0
+ISR_NOERR 1
+ISR_NOERR 2
+ISR_NOERR 3
+ISR_NOERR 4
+ISR_NOERR 5
+ISR_NOERR 6
+ISR_NOERR 7
+ISR_ERR   8
+ISR_NOERR 9
+ISR_ERR   10
+ISR_ERR   11
+ISR_ERR   12
+ISR_ERR   13
+ISR_ERR   14
+ISR_NOERR 15
+ISR_NOERR 16
+ISR_ERR   17
+ISR_NOERR 18
+ISR_NOERR 19
+ISR_NOERR 20
+ISR_ERR   21
+ISR_NOERR 22
+ISR_NOERR 23
+ISR_NOERR 24
+ISR_NOERR 25
+ISR_NOERR 26
+ISR_NOERR 27
+ISR_NOERR 28
+ISR_ERR   29
+ISR_ERR   30
+ISR_NOERR 31
+
+ISR_NOERR 32
+ISR_NOERR 33
+ISR_NOERR 34
+ISR_NOERR 35
+ISR_NOERR 36
+ISR_NOERR 37
+ISR_NOERR 38
+ISR_NOERR 39
+ISR_NOERR 40
+ISR_NOERR 41
+ISR_NOERR 42
+ISR_NOERR 43
+ISR_NOERR 44
+ISR_NOERR 45
+ISR_NOERR 46
+ISR_NOERR 47
+
+ISR_NOERR 48
+ISR_NOERR 49
+ISR_NOERR 50
+ISR_NOERR 51
+
+; LAPIC spurious interrupts must not be acknowledged.
+isr_stub_spurious:
+    iret
+
+isr_common:
+    pusha
+    cld
+    push esp
+    call isr_dispatch
+    add esp, 4
+    popa
+    add esp, 8
+    iret
+
+section .rodata
+isr_stub_table:
+%assign vec 0
+%rep 52
+    dd isr_stub_%+vec
+%assign vec vec + 1
+%endrep
@@ -0,0 +1,127 @@
+#include "arch/lapic.h"
+#include "arch/cpu.h"
+#include "mm/vmm.h"
+
+#define CPUID_EDX_APIC (1u << 9)
+
+#define LAPIC_BASE_MSR 0x1B
+#define LAPIC_BASE_ENABLE (1u << 11)
+#define LAPIC_BASE_MASK 0xFFFFF000u
+
+#define LAPIC_REG_ID 0x020
+#define LAPIC_REG_TPR 0x080
+#define LAPIC_REG_EOI 0x0B0
+#define LAPIC_REG_SVR 0x0F0
+#define LAPIC_REG_ESR 0x280
+#define LAPIC_REG_ICR_LOW 0x300
+#define LAPIC_REG_ICR_HIGH 0x310
+#define LAPIC_REG_LVT_TIMER 0x320
+#define LAPIC_REG_LVT_LINT0 0x350
+#define LAPIC_REG_LVT_LINT1 0x360
+#define LAPIC_REG_LVT_ERROR 0x370
+
+#define LAPIC_SVR_ENABLE 0x100u
+#define LAPIC_LVT_MASKED 0x10000u
+#define LAPIC_LVT_EXTINT 0x700u
+#define LAPIC_LVT_NMI 0x400u
+
+#define LAPIC_ICR_FIXED 0x000u
+#define LAPIC_ICR_INIT 0x500u
+#define LAPIC_ICR_STARTUP 0x600u
+#define LAPIC_ICR_PENDING 0x1000u
+#define LAPIC_ICR_ASSERT 0x4000u
+#define LAPIC_ICR_ALL_BUT_SELF 0xC0000u
+
+/* Mapped uncached into the dynamic region by the boot CPU; APs share it. */
+static volatile uint32_t *lapic_base;
+
+static uint32_t lapic_read(uint32_t reg)
+{
+  return lapic_base[reg / 4];
+}
+
+static void lapic_write(uint32_t reg, uint32_t value)
+{
+  lapic_base[reg / 4] = value;
+}
+
+static void lapic_wait_icr(void)
+{
+  while (lapic_read(LAPIC_REG_ICR_LOW) & LAPIC_ICR_PENDING)
+  {
+    __asm__ __volatile__("pause" : : : "memory");
+  }
+}
+
+static void lapic_send_icr(uint8_t apic_id, uint32_t low)
+{
+  uint32_t flags = cpu_irq_save();
+  lapic_wait_icr();
+  lapic_write(LAPIC_REG_ICR_HIGH, (uint32_t)apic_id << 24);
+  lapic_write(LAPIC_REG_ICR_LOW, low);
+  lapic_wait_icr();
+  cpu_irq_restore(flags);
+}
+
+int lapic_present(void)
+{
+  uint32_t edx = 0;
+  cpu_cpuid(1, 0, 0, 0, &edx);
+  return (edx & CPUID_EDX_APIC) != 0;
+}
+
+int lapic_init(int bsp)
+{
+  uint64_t msr = cpu_rdmsr(LAPIC_BASE_MSR);
+  if (bsp)
+  {
+    lapic_base = (volatile uint32_t *)vmm_map_mmio((uint32_t)msr & LAPIC_BASE_MASK, PAGE_SIZE);
+  }
+  if (!lapic_base)
+  {
+    return -1;
+  }
+  cpu_wrmsr(LAPIC_BASE_MSR, msr | LAPIC_BASE_ENABLE);
+
+  lapic_write(LAPIC_REG_TPR, 0);
+  lapic_write(LAPIC_REG_LVT_TIMER, LAPIC_LVT_MASKED);
+  lapic_write(LAPIC_REG_LVT_ERROR, LAPIC_LVT_MASKED);
+  /* The 8259 stays in charge of device IRQs through the boot CPU's LINT0. */
+  lapic_write(LAPIC_REG_LVT_LINT0, bsp ? LAPIC_LVT_EXTINT : LAPIC_LVT_MASKED);
+  lapic_write(LAPIC_REG_LVT_LINT1, LAPIC_LVT_NMI);
+  lapic_write(LAPIC_REG_ESR, 0);
+  lapic_write(LAPIC_REG_SVR, LAPIC_SVR_ENABLE | LAPIC_SPURIOUS_VECTOR);
+  lapic_eoi();
+  return 0;
+}
+
+uint8_t lapic_id(void)
+{
+  return (uint8_t)(lapic_read(LAPIC_REG_ID) >> 24);
+}
+
+void lapic_eoi(void)
+{
+  lapic_write(LAPIC_REG_EOI, 0);
+}
+
+void lapic_send_ipi(uint8_t apic_id, uint8_t vector)
+{
+  lapic_send_icr(apic_id, LAPIC_ICR_FIXED | LAPIC_ICR_ASSERT | vector);
+}
+
+void lapic_broadcast_ipi(uint8_t vector)
+{
+  lapic_send_icr(0, LAPIC_ICR_ALL_BUT_SELF | LAPIC_ICR_FIXED | LAPIC_ICR_ASSERT | vector);
+}
+
+void lapic_send_init_all(void)
+{
+  lapic_send_icr(0, LAPIC_ICR_ALL_BUT_SELF | LAPIC_ICR_INIT | LAPIC_ICR_ASSERT);
+}
+
+void lapic_send_startup_all(uint32_t trampoline)
+{
+  /* The vector field holds the 4 KiB page the APs start executing at. */
+  lapic_send_icr(0, LAPIC_ICR_ALL_BUT_SELF | LAPIC_ICR_STARTUP | ((trampoline >> 12) & 0xFF));
+}
@@ -0,0 +1,92 @@
+#include "arch/pic.h"
+#include "arch/io.h"
+
+#define PIC1_CMD 0x20
+#define PIC1_DATA 0x21
+#define PIC2_CMD 0xA0
+#define PIC2_DATA 0xA1
+
+#define PIC_EOI 0x20
+#define PIC_READ_ISR 0x0B
+#define PIC_CASCADE_IRQ 2
+
+static void pic_io_wait(void)
+{
+  outb(0x80, 0);
+}
+
+void pic_init(void)
+{
+  /* ICW1: edge triggered, cascade, expect ICW4 */
+  outb(PIC1_CMD, 0x11);
+  pic_io_wait();
+  outb(PIC2_CMD, 0x11);
+  pic_io_wait();
+
+  /* ICW2: move IRQ 0-15 above the CPU exception vectors */
+  outb(PIC1_DATA, PIC_IRQ_BASE);
+  pic_io_wait();
+  outb(PIC2_DATA, PIC_IRQ_BASE + 8);
+  pic_io_wait();
+
+  /* ICW3: slave on IRQ2 */
+  outb(PIC1_DATA, 1u << PIC_CASCADE_IRQ);
+  pic_io_wait();
+  outb(PIC2_DATA, PIC_CASCADE_IRQ);
+  pic_io_wait();
+
+  /* ICW4: 8086 mode */
+  outb(PIC1_DATA, 0x01);
+  pic_io_wait();
+  outb(PIC2_DATA, 0x01);
+  pic_io_wait();
+
+  /* Everything masked until a driver claims its line. */
+  outb(PIC1_DATA, (uint8_t)~(1u << PIC_CASCADE_IRQ));
+  outb(PIC2_DATA, 0xFF);
+}
+
+void pic_mask(uint8_t irq)
+{
+  uint16_t port = irq < 8 ? PIC1_DATA : PIC2_DATA;
+  uint8_t bit = (uint8_t)(1u << (irq & 7));
+  outb(port, (uint8_t)(inb(port) | bit));
+}
+
+void pic_unmask(uint8_t irq)
+{
+  uint16_t port = irq < 8 ? PIC1_DATA : PIC2_DATA;
+  uint8_t bit = (uint8_t)(1u << (irq & 7));
+  outb(port, (uint8_t)(inb(port) & (uint8_t)~bit));
+}
+
+void pic_send_eoi(uint8_t irq)
+{
+  if (irq >= 8)
+  {
+    outb(PIC2_CMD, PIC_EOI);
+  }
+  outb(PIC1_CMD, PIC_EOI);
+}
+
+int pic_is_spurious(uint8_t irq)
+{
+  if (irq != 7 && irq != 15)
+  {
+    return 0;
+  }
+
+  uint16_t port = irq == 7 ? PIC1_CMD : PIC2_CMD;
+  outb(port, PIC_READ_ISR);
+  if (inb(port) & 0x80)
+  {
+    return 0;
+  }
+
+  /* A spurious IRQ15 still needs the master acknowledged for the cascade. */
+  if (irq == 15)
+  {
+    outb(PIC1_CMD, PIC_EOI);
+  }
+  return 1;
+}
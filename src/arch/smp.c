@@ -0,0 +1,227 @@
+#include "arch/smp.h"
+#include "arch/lapic.h"
+#include "arch/gdt.h"
+#include "arch/cpu.h"
+#include "arch/spinlock.h"
+#include "mm/vmm.h"
+#include "lib/string.h"
+#include "proc/process.h"
+#include "sys/clock.h"
+#include "sys/log.h"
+
+#define SMP_TRAMPOLINE_ADDR 0x8000u
+#define SMP_AP_STACK_SIZE 4096u
+#define SMP_INIT_DELAY_NS 10000000u
+#define SMP_SIPI_DELAY_NS 200000u
+#define SMP_SETTLE_NS 10000000u
+#define SMP_BOOT_TIMEOUT_NS 100000000u
+
+extern uint8_t ap_trampoline_start[];
+extern uint8_t ap_trampoline_end[];
+extern volatile uint32_t ap_boot_next;
+extern uint32_t ap_boot_max;
+extern uint32_t ap_boot_stacks;
+extern uint32_t ap_boot_stack_size;
+extern uint32_t ap_boot_cr3;
+
+void ap_main(uint32_t cpu);
+
+/* Each AP's boot stack becomes the stack of its idle loop. */
+static uint8_t smp_ap_stacks[SMP_MAX_CPUS - 1][SMP_AP_STACK_SIZE] __attribute__((aligned(16)));
+static uint8_t smp_apic_ids[SMP_MAX_CPUS];
+static uint8_t smp_cpu_of_apic[256];
+static volatile uint32_t smp_online = 1;
+static int smp_enabled;
+static spinlock_t smp_tlb_lock = SPINLOCK_INIT;
+static volatile uintptr_t smp_tlb_addr;
+/* Bit n is set until CPU n has flushed smp_tlb_addr. */
+static volatile uint32_t smp_tlb_mask;
+
+static void smp_delay_ns(uint64_t ns)
+{
+  uint64_t end = clock_ns() + ns;
+  while (clock_ns() < end)
+  {
+    __asm__ __volatile__("pause" : : : "memory");
+  }
+}
+
+static void smp_tick_ipi(interrupt_frame_t *frame)
+{
+  (void)frame;
+  process_timer_tick();
+}
+
+static void smp_reschedule_ipi(interrupt_frame_t *frame)
+{
+  (void)frame;
+  process_reschedule();
+}
+
+static void smp_tlb_service(void)
+{
+  uint32_t bit = 1u << smp_cpu_id();
+  if (!(smp_tlb_mask & bit))
+  {
+    return;
+  }
+  if (smp_tlb_addr == SMP_TLB_FLUSH_ALL)
+  {
+    uint32_t cr3;
+    __asm__ __volatile__("mov %%cr3, %0\n\tmov %0, %%cr3" : "=r"(cr3) : : "memory");
+  }
+  else
+  {
+    __asm__ __volatile__("invlpg (%0)" : : "r"(smp_tlb_addr) : "memory");
+  }
+  __atomic_and_fetch(&smp_tlb_mask, ~bit, __ATOMIC_RELEASE);
+}
+
+static void smp_tlb_ipi(interrupt_frame_t *frame)
+{
+  (void)frame;
+  smp_tlb_service();
+}
+
+static void smp_stop_ipi(interrupt_frame_t *frame)
+{
+  (void)frame;
+  for (;;)
+  {
+    cpu_irq_disable();
+    cpu_halt();
+  }
+}
+
+void ap_main(uint32_t cpu)
+{
+  gdt_init();
+  idt_load();
+  (void)lapic_init(0);
+
+  uint8_t apic = lapic_id();
+  smp_apic_ids[cpu] = apic;
+  smp_cpu_of_apic[apic] = (uint8_t)cpu;
+  __atomic_add_fetch(&smp_online, 1u, __ATOMIC_RELEASE);
+
+  process_ap_start(cpu);
+}
+
+void smp_init(void)
+{
+  if (!lapic_present() || !cpu_has_tsc())
+  {
+    log_info("smp: no local APIC, running on one CPU");
+    return;
+  }
+
+  if (lapic_init(1) != 0)
+  {
+    log_warn("smp: local APIC not mappable, running on one CPU");
+    return;
+  }
+  smp_apic_ids[0] = lapic_id();
+  smp_cpu_of_apic[smp_apic_ids[0]] = 0;
+  smp_enabled = 1;
+
+  (void)ipi_register(SMP_IPI_TICK, smp_tick_ipi);
+  (void)ipi_register(SMP_IPI_RESCHEDULE, smp_reschedule_ipi);
+  (void)ipi_register(SMP_IPI_STOP, smp_stop_ipi);
+  (void)ipi_register(SMP_IPI_TLB, smp_tlb_ipi);
+
+  /* APs switch paging on from inside the copy, before they can see the kernel. */
+  ap_boot_cr3 = virt_to_phys(boot_page_directory);
+  memcpy(phys_to_virt(SMP_TRAMPOLINE_ADDR), ap_trampoline_start,
+         (size_t)(ap_trampoline_end - ap_trampoline_start));
+  ap_boot_next = 0;
+  ap_boot_max = SMP_MAX_CPUS;
+  ap_boot_stacks = (uint32_t)(uintptr_t)smp_ap_stacks;
+  ap_boot_stack_size = SMP_AP_STACK_SIZE;
+
+  lapic_send_init_all();
+  smp_delay_ns(SMP_INIT_DELAY_NS);
+  lapic_send_startup_all(SMP_TRAMPOLINE_ADDR);
+  smp_delay_ns(SMP_SIPI_DELAY_NS);
+  lapic_send_startup_all(SMP_TRAMPOLINE_ADDR);
+  smp_delay_ns(SMP_SETTLE_NS);
+
+  /* Every AP that claimed an index must check in before we go on. */
+  uint32_t started = ap_boot_next;
+  if (started > SMP_MAX_CPUS - 1)
+  {
+    started = SMP_MAX_CPUS - 1;
+  }
+  uint64_t deadline = clock_ns() + SMP_BOOT_TIMEOUT_NS;
+  while (smp_online < started + 1 && clock_ns() < deadline)
+  {
+    __asm__ __volatile__("pause" : : : "memory");
+  }
+
+  char msg[] = "smp: 0 CPUs online";
+  msg[5] = (char)('0' + smp_online);
+  log_info(msg);
+}
+
+uint32_t smp_cpu_count(void)
+{
+  return smp_online;
+}
+
+uint32_t smp_cpu_id(void)
+{
+  if (!smp_enabled)
+  {
+    return 0;
+  }
+  return smp_cpu_of_apic[lapic_id()];
+}
+
+void smp_broadcast_tick(void)
+{
+  if (smp_online > 1)
+  {
+    lapic_broadcast_ipi(SMP_IPI_TICK);
+  }
+}
+
+void smp_send_reschedule(uint32_t cpu)
+{
+  if (cpu < SMP_MAX_CPUS)
+  {
+    lapic_send_ipi(smp_apic_ids[cpu], SMP_IPI_RESCHEDULE);
+  }
+}
+
+void smp_stop_others(void)
+{
+  if (smp_online > 1)
+  {
+    lapic_broadcast_ipi(SMP_IPI_STOP);
+  }
+}
+
+void smp_tlb_shootdown(uintptr_t virt)
+{
+  if (!smp_enabled || smp_online < 2)
+  {
+    return;
+  }
+
+  uint32_t flags = cpu_irq_save();
+  uint32_t self = smp_cpu_id();
+  /* Keep answering other shootdowns while waiting our turn. */
+  while (__atomic_exchange_n(&smp_tlb_lock.locked, 1u, __ATOMIC_ACQUIRE))
+  {
+    smp_tlb_service();
+    __asm__ __volatile__("pause" : : : "memory");
+  }
+  smp_tlb_addr = virt;
+  __atomic_store_n(&smp_tlb_mask, ((1u << smp_online) - 1u) & ~(1u << self), __ATOMIC_RELEASE);
+  lapic_broadcast_ipi(SMP_IPI_TLB);
+  while (smp_tlb_mask)
+  {
+    __asm__ __volatile__("pause" : : : "memory");
+  }
+  spin_unlock(&smp_tlb_lock);
+  cpu_irq_restore(flags);
+}
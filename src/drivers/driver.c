@@ -1,10 +1,12 @@
 #include "drivers/driver.h"
 #include "drivers/vga.h"
 #include "drivers/keyboard.h"
+#include "drivers/pit.h"
 
 static driver_t kdrivers[] = {
     {"vga", vga_init},
     {"keyboard", keyboard_init},
+    {"pit", pit_init},
 };
 
 void drivers_init(void)
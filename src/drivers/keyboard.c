@@ -1,9 +1,16 @@
 #include "drivers/keyboard.h"
 #include "arch/io.h"
+#include "arch/cpu.h"
+#include "arch/idt.h"
+#include "proc/wait.h"
 
 #define KBD_DATA_PORT 0x60
 #define KBD_STATUS_PORT 0x64
 #define KBD_CMD_PORT 0x64
+#define KBD_IRQ 1
+
+/* Power of two so the free-running indices can be masked. */
+#define KBD_RING_SIZE 64
 
 static const char kbd_us_map[128] = {
     0, 27, '1', '2', '3', '4', '5', '6',
@@ -44,10 +51,88 @@ static uint8_t kbd_caps;
 static uint8_t kbd_e0;
 static uint8_t kbd_ctrl;
 
+/*
+ * Single-producer (IRQ1) / single-consumer (tty) scancode ring. The producer
+ * only writes kbd_ring_head and the consumer only writes kbd_ring_tail, so
+ * neither side needs to mask interrupts to move data.
+ */
+static volatile uint8_t kbd_ring[KBD_RING_SIZE];
+static volatile uint32_t kbd_ring_head;
+static volatile uint32_t kbd_ring_tail;
+static volatile uint32_t kbd_ring_dropped;
+static wait_queue_t kbd_wait = WAIT_QUEUE_INIT;
+
+static void kbd_wait_input_clear(void)
+{
+  for (uint32_t i = 0; i < 100000; ++i)
+  {
+    if ((inb(KBD_STATUS_PORT) & 0x02) == 0)
+    {
+      return;
+    }
+  }
+}
+
+static void kbd_irq(interrupt_frame_t *frame)
+{
+  (void)frame;
+  uint8_t scancode = inb(KBD_DATA_PORT);
+  uint32_t head = kbd_ring_head;
+  if (head - kbd_ring_tail >= KBD_RING_SIZE)
+  {
+    kbd_ring_dropped++;
+  }
+  else
+  {
+    kbd_ring[head & (KBD_RING_SIZE - 1)] = scancode;
+    __asm__ __volatile__("" : : : "memory");
+    kbd_ring_head = head + 1;
+  }
+
+  (void)wake_up(&kbd_wait);
+}
+
+static int kbd_ring_pop(uint8_t *scancode)
+{
+  uint32_t tail = kbd_ring_tail;
+  if (tail == kbd_ring_head)
+  {
+    return 0;
+  }
+  *scancode = kbd_ring[tail & (KBD_RING_SIZE - 1)];
+  __asm__ __volatile__("" : : : "memory");
+  kbd_ring_tail = tail + 1;
+  return 1;
+}
+
 int keyboard_init(void)
 {
+  kbd_ring_head = 0;
+  kbd_ring_tail = 0;
+  kbd_ring_dropped = 0;
+  wait_queue_init(&kbd_wait);
+
+  kbd_wait_input_clear();
   outb(KBD_CMD_PORT, 0xAE);
-  return 0;
+
+  /* Make sure the controller raises IRQ1 for the first port. */
+  kbd_wait_input_clear();
+  outb(KBD_CMD_PORT, 0x20);
+  for (uint32_t i = 0; i < 100000 && !keyboard_has_data(); ++i)
+  {
+  }
+  uint8_t config = keyboard_read_scancode();
+  kbd_wait_input_clear();
+  outb(KBD_CMD_PORT, 0x60);
+  kbd_wait_input_clear();
+  outb(KBD_DATA_PORT, (uint8_t)(config | 0x01));
+
+  while (keyboard_has_data())
+  {
+    (void)keyboard_read_scancode();
+  }
+
+  return irq_register(KBD_IRQ, kbd_irq);
 }
 
 int keyboard_has_data(void)
@@ -60,14 +145,8 @@ uint8_t keyboard_read_scancode(void)
   return inb(KBD_DATA_PORT);
 }
 
-int keyboard_poll_key(void)
+static int keyboard_decode(uint8_t scancode)
 {
-  if (!keyboard_has_data())
-  {
-    return 0;
-  }
-
-  uint8_t scancode = keyboard_read_scancode();
   if (scancode == 0xE0)
   {
     kbd_e0 = 1;
@@ -172,3 +251,49 @@ int keyboard_poll_key(void)
 
   return (int)ch;
 }
+
+int keyboard_poll_key(void)
+{
+  uint8_t scancode = 0;
+  while (kbd_ring_pop(&scancode))
+  {
+    int key = keyboard_decode(scancode);
+    if (key != 0)
+    {
+      return key;
+    }
+  }
+  return 0;
+}
+
+int keyboard_read_key(void)
+{
+  for (;;)
+  {
+    int key = keyboard_poll_key();
+    if (key != 0)
+    {
+      return key;
+    }
+
+    wait_event(kbd_wait, kbd_ring_tail != kbd_ring_head);
+  }
+}
+
+int keyboard_poll_raw(void)
+{
+  while (keyboard_has_data())
+  {
+    int key = keyboard_decode(keyboard_read_scancode());
+    if (key != 0)
+    {
+      return key;
+    }
+  }
+  return 0;
+}
+
+uint32_t keyboard_dropped(void)
+{
+  return kbd_ring_dropped;
+}
@@ -0,0 +1,46 @@
+#include "drivers/pit.h"
+#include "arch/io.h"
+#include "arch/smp.h"
+#include "arch/idt.h"
+#include "proc/process.h"
+#include "sys/timer.h"
+
+#define PIT_CHANNEL0 0x40
+#define PIT_CMD 0x43
+#define PIT_IRQ 0
+
+static volatile uint64_t pit_tick_count;
+
+static void pit_irq(interrupt_frame_t *frame)
+{
+  (void)frame;
+  pit_tick_count++;
+  timer_tick();
+  /* Only the boot CPU sees IRQ0; the others tick off this IPI. */
+  smp_broadcast_tick();
+  process_timer_tick();
+}
+
+int pit_init(void)
+{
+  uint32_t divisor = PIT_BASE_HZ / PIT_TICK_HZ;
+
+  /* Channel 0, lobyte/hibyte, mode 2 (rate generator). */
+  outb(PIT_CMD, 0x34);
+  outb(PIT_CHANNEL0, (uint8_t)(divisor & 0xFF));
+  outb(PIT_CHANNEL0, (uint8_t)((divisor >> 8) & 0xFF));
+
+  pit_tick_count = 0;
+  return irq_register(PIT_IRQ, pit_irq);
+}
+
+uint64_t pit_ticks(void)
+{
+  /* Only the boot CPU writes the count; retry if an update tore the read. */
+  uint64_t ticks;
+  do
+  {
+    ticks = pit_tick_count;
+  } while (ticks != pit_tick_count);
+  return ticks;
+}
@@ -1,47 +1,119 @@
 #include "drivers/vga.h"
 #include "arch/io.h"
+#include "arch/spinlock.h"
+#include "mm/vmm.h"
+#include "sys/timer.h"
+#include "lib/string.h"
 
 #define VGA_WIDTH 80
 #define VGA_HEIGHT 25
 #define VGA_PORT_CMD 0x3D4
 #define VGA_PORT_DATA 0x3D5
 #define VGA_TAB_WIDTH 4
+#define VGA_ALL_ROWS ((1u << VGA_HEIGHT) - 1u)
+#define VGA_CURSOR_UNKNOWN 0xFFFFu
 
-static volatile uint16_t *const vga_buffer = (uint16_t *)0xB8000;
+/*
+ * Drawing only touches vga_shadow and marks rows in vga_dirty. A flush
+ * copies dirty rows that differ from vga_front (what the hardware shows)
+ * and moves the hardware cursor once. It runs VGA_FLUSH_MS after the
+ * first change, or at once through vga_flush.
+ */
+static volatile uint16_t *const vga_buffer = (uint16_t *)(KERNEL_VIRT_BASE + 0xB8000u);
+static uint16_t vga_shadow[VGA_WIDTH * VGA_HEIGHT];
+static uint16_t vga_front[VGA_WIDTH * VGA_HEIGHT];
+static uint32_t vga_dirty;
+static uint16_t vga_hw_cursor = VGA_CURSOR_UNKNOWN;
+/* Until vga_init sets up the timer, and after vga_emergency, every change is flushed at once. */
+static int vga_deferred;
+static int vga_flush_armed;
+static ktimer_t vga_flush_timer;
+static spinlock_t vga_lock = SPINLOCK_INIT;
 static uint8_t vga_color = 0x0F;
 static uint16_t cursor_row;
 static uint16_t cursor_col;
 
-static void vga_update_cursor(void)
+static uint16_t vga_cell(char ch)
 {
-  uint16_t pos = (uint16_t)(cursor_row * VGA_WIDTH + cursor_col);
-  outb(VGA_PORT_CMD, 0x0F);
-  outb(VGA_PORT_DATA, (uint8_t)(pos & 0xFF));
-  outb(VGA_PORT_CMD, 0x0E);
-  outb(VGA_PORT_DATA, (uint8_t)((pos >> 8) & 0xFF));
+  return (uint16_t)(((uint16_t)vga_color << 8) | (uint8_t)ch);
 }
 
-static void vga_scroll_if_needed(void)
+static int row_unchanged(uint32_t row)
 {
-  if (cursor_row < VGA_HEIGHT)
+  const uint16_t *shadow = &vga_shadow[row * VGA_WIDTH];
+  const uint16_t *front = &vga_front[row * VGA_WIDTH];
+  for (uint32_t col = 0; col < VGA_WIDTH; ++col)
   {
-    return;
+    if (shadow[col] != front[col])
+    {
+      return 0;
+    }
   }
+  return 1;
+}
 
-  for (uint32_t row = 1; row < VGA_HEIGHT; ++row)
+static void flush_locked(void)
+{
+  uint32_t dirty = vga_dirty;
+  vga_dirty = 0;
+  vga_flush_armed = 0;
+  for (uint32_t row = 0; dirty; ++row, dirty >>= 1)
   {
-    for (uint32_t col = 0; col < VGA_WIDTH; ++col)
+    if (!(dirty & 1u) || row_unchanged(row))
     {
-      vga_buffer[(row - 1) * VGA_WIDTH + col] =
-          vga_buffer[row * VGA_WIDTH + col];
+      continue;
     }
+    uint32_t offset = row * VGA_WIDTH;
+    memcpy(&vga_front[offset], &vga_shadow[offset], VGA_WIDTH * sizeof(uint16_t));
+    memcpy((void *)&vga_buffer[offset], &vga_shadow[offset], VGA_WIDTH * sizeof(uint16_t));
+  }
+
+  uint16_t pos = (uint16_t)(cursor_row * VGA_WIDTH + cursor_col);
+  if (pos != vga_hw_cursor)
+  {
+    outb(VGA_PORT_CMD, 0x0F);
+    outb(VGA_PORT_DATA, (uint8_t)(pos & 0xFF));
+    outb(VGA_PORT_CMD, 0x0E);
+    outb(VGA_PORT_DATA, (uint8_t)((pos >> 8) & 0xFF));
+    vga_hw_cursor = pos;
+  }
+}
+
+static void vga_flush_timeout(void *arg)
+{
+  (void)arg;
+  uint32_t flags = spin_lock_irqsave(&vga_lock);
+  flush_locked();
+  spin_unlock_irqrestore(&vga_lock, flags);
+}
+
+/* Ends every drawing call: batches the change, or flushes it when batching is off. */
+static void vga_changed(void)
+{
+  if (!vga_deferred)
+  {
+    flush_locked();
+  }
+  else if (!vga_flush_armed)
+  {
+    vga_flush_armed = 1;
+    timer_start(&vga_flush_timer, VGA_FLUSH_MS);
+  }
+}
+
+static void vga_scroll_if_needed(void)
+{
+  if (cursor_row < VGA_HEIGHT)
+  {
+    return;
   }
 
+  memmove(vga_shadow, vga_shadow + VGA_WIDTH, (VGA_HEIGHT - 1) * VGA_WIDTH * sizeof(uint16_t));
   for (uint32_t col = 0; col < VGA_WIDTH; ++col)
   {
-    vga_buffer[(VGA_HEIGHT - 1) * VGA_WIDTH + col] =
-        ((uint16_t)vga_color << 8) | ' ';
+    vga_shadow[(VGA_HEIGHT - 1) * VGA_WIDTH + col] = vga_cell(' ');
   }
+  vga_dirty = VGA_ALL_ROWS;
 
   cursor_row = VGA_HEIGHT - 1;
 }
@@ -60,19 +132,39 @@ static void vga_clamp_cursor(void)
 
 int vga_init(void)
 {
+  timer_setup(&vga_flush_timer, vga_flush_timeout, 0);
   vga_clear();
+  vga_deferred = 1;
   return 0;
 }
 
+void vga_flush(void)
+{
+  uint32_t flags = spin_lock_irqsave(&vga_lock);
+  flush_locked();
+  spin_unlock_irqrestore(&vga_lock, flags);
+}
+
+void vga_emergency(void)
+{
+  spin_init(&vga_lock);
+  vga_deferred = 0;
+  vga_flush_armed = 0;
+  flush_locked();
+}
+
 void vga_clear(void)
 {
+  uint32_t flags = spin_lock_irqsave(&vga_lock);
   for (uint32_t i = 0; i < VGA_WIDTH * VGA_HEIGHT; ++i)
   {
-    vga_buffer[i] = ((uint16_t)vga_color << 8) | ' ';
+    vga_shadow[i] = vga_cell(' ');
   }
+  vga_dirty = VGA_ALL_ROWS;
   cursor_row = 0;
   cursor_col = 0;
-  vga_update_cursor();
+  vga_changed();
+  spin_unlock_irqrestore(&vga_lock, flags);
 }
 
 void vga_set_color(uint8_t fg, uint8_t bg)
@@ -87,11 +179,17 @@ uint8_t vga_get_color(void)
 
 void vga_write(const char *str, uint16_t row, uint16_t col)
 {
+  uint32_t flags = spin_lock_irqsave(&vga_lock);
   uint16_t offset = (uint16_t)(row * VGA_WIDTH + col);
   uint16_t i = 0;
   for (; str[i] != '\0'; ++i)
   {
-    vga_buffer[offset + i] = ((uint16_t)vga_color << 8) | (uint8_t)str[i];
+    vga_shadow[offset + i] = vga_cell(str[i]);
+  }
+  uint32_t last = (uint32_t)(offset + (i ? i - 1 : 0)) / VGA_WIDTH;
+  for (uint32_t r = row; r <= last && r < VGA_HEIGHT; ++r)
+  {
+    vga_dirty |= 1u << r;
   }
   cursor_row = row;
   cursor_col = (uint16_t)(col + i);
@@ -101,17 +199,19 @@ void vga_write(const char *str, uint16_t row, uint16_t col)
     cursor_row = (uint16_t)(cursor_row + 1);
   }
   vga_scroll_if_needed();
-  vga_update_cursor();
+  vga_changed();
+  spin_unlock_irqrestore(&vga_lock, flags);
 }
 
 void vga_set_cursor(uint16_t row, uint16_t col)
 {
+  uint32_t flags = spin_lock_irqsave(&vga_lock);
   cursor_row = row;
   cursor_col = col;
   vga_clamp_cursor();
-  vga_update_cursor();
+  vga_changed();
+  spin_unlock_irqrestore(&vga_lock, flags);
 }
-
 void vga_get_cursor(uint16_t *row, uint16_t *col)
 {
   if (row)
@@ -126,6 +226,7 @@ void vga_get_cursor(uint16_t *row, uint16_t *col)
 
 void vga_move_cursor(int16_t drow, int16_t dcol)
 {
+  uint32_t flags = spin_lock_irqsave(&vga_lock);
   int32_t new_row = (int32_t)cursor_row + drow;
   int32_t new_col = (int32_t)cursor_col + dcol;
 
@@ -148,17 +249,17 @@ void vga_move_cursor(int16_t drow, int16_t dcol)
 
   cursor_row = (uint16_t)new_row;
   cursor_col = (uint16_t)new_col;
-  vga_update_cursor();
+  vga_changed();
+  spin_unlock_irqrestore(&vga_lock, flags);
 }
 
-void vga_putc(char ch)
+static void putc_locked(char ch)
 {
   if (ch == '\n')
   {
     cursor_col = 0;
     cursor_row = (uint16_t)(cursor_row + 1);
     vga_scroll_if_needed();
-    vga_update_cursor();
     return;
   }
 
@@ -175,14 +276,12 @@ void vga_putc(char ch)
     {
       cursor_col = next;
     }
-    vga_update_cursor();
     return;
   }
 
   if (ch == '\r')
   {
     cursor_col = 0;
-    vga_update_cursor();
     return;
   }
 
@@ -191,15 +290,14 @@ void vga_putc(char ch)
     if (cursor_col > 0)
     {
       cursor_col--;
-      vga_buffer[cursor_row * VGA_WIDTH + cursor_col] =
-          ((uint16_t)vga_color << 8) | ' ';
+      vga_shadow[cursor_row * VGA_WIDTH + cursor_col] = vga_cell(' ');
+      vga_dirty |= 1u << cursor_row;
     }
-    vga_update_cursor();
     return;
   }
 
-  vga_buffer[cursor_row * VGA_WIDTH + cursor_col] =
-      ((uint16_t)vga_color << 8) | (uint8_t)ch;
+  vga_shadow[cursor_row * VGA_WIDTH + cursor_col] = vga_cell(ch);
+  vga_dirty |= 1u << cursor_row;
   cursor_col++;
   if (cursor_col >= VGA_WIDTH)
   {
@@ -207,5 +305,23 @@ void vga_putc(char ch)
     cursor_row = (uint16_t)(cursor_row + 1);
     vga_scroll_if_needed();
   }
-  vga_update_cursor();
+}
+
+void vga_putc(char ch)
+{
+  uint32_t flags = spin_lock_irqsave(&vga_lock);
+  putc_locked(ch);
+  vga_changed();
+  spin_unlock_irqrestore(&vga_lock, flags);
+}
+
+void vga_puts(const char *str)
+{
+  uint32_t flags = spin_lock_irqsave(&vga_lock);
+  while (*str)
+  {
+    putc_locked(*str++);
+  }
+  vga_changed();
+  spin_unlock_irqrestore(&vga_lock, flags);
 }
@@ -0,0 +1,45 @@
+#include "lib/format.h"
+
+#define FMT_CHUNK 1000000000u
+#define FMT_CHUNK_DIGITS 9
+
+size_t fmt_u64(char *buf, uint64_t value)
+{
+  /* Nine digits per 64-bit divide; the digits themselves need only 32-bit math. */
+  char digits[FMT_U64_MAX];
+  size_t count = 0;
+  do
+  {
+    uint32_t chunk;
+    value = u64_div_u32(value, FMT_CHUNK, &chunk);
+    for (int i = 0; i < FMT_CHUNK_DIGITS && (chunk || value); ++i)
+    {
+      digits[count++] = (char)('0' + chunk % 10u);
+      chunk /= 10u;
+    }
+  } while (value);
+  if (count == 0)
+  {
+    digits[count++] = '0';
+  }
+
+  for (size_t i = 0; i < count; ++i)
+  {
+    buf[i] = digits[count - 1 - i];
+  }
+  buf[count] = '\0';
+  return count;
+}
+
+size_t fmt_hex32(char *buf, uint32_t value)
+{
+  static const char hex[] = "0123456789ABCDEF";
+  buf[0] = '0';
+  buf[1] = 'x';
+  for (int i = 0; i < 8; ++i)
+  {
+    buf[2 + i] = hex[(value >> (28 - 4 * i)) & 0x0F];
+  }
+  buf[10] = '\0';
+  return 10;
+}
@@ -0,0 +1,213 @@
+#include "lib/string.h"
+#include "arch/cpu.h"
+#include <stdint.h>
+
+/* Lets strlen read a word of chars without breaking aliasing rules. */
+typedef uint32_t __attribute__((may_alias)) string_word_t;
+
+static int string_simd;
+
+void string_init(void)
+{
+  string_simd = cpu_has_sse2() && cpu_fpu_enabled();
+}
+
+const char *string_impl(void)
+{
+  return string_simd ? "sse2" : "rep movsd";
+}
+
+static int simd_usable(size_t n)
+{
+  return string_simd && n >= STRING_SIMD_MIN && cpu_irq_enabled();
+}
+
+static void copy_rep(uint8_t *dst, const uint8_t *src, size_t n)
+{
+  size_t dwords = n >> 2;
+  size_t bytes = n & 3u;
+  __asm__ __volatile__("rep movsl" : "+D"(dst), "+S"(src), "+c"(dwords) : : "memory");
+  __asm__ __volatile__("rep movsb" : "+D"(dst), "+S"(src), "+c"(bytes) : : "memory");
+}
+
+/*
+ * Aligns the destination, then moves 64 bytes per iteration. The kernel is
+ * built with -mno-sse, so the compiler never keeps anything in the XMM
+ * registers these clobber (and will not accept them as clobbers).
+ */
+static void copy_sse2(uint8_t *dst, const uint8_t *src, size_t n)
+{
+  size_t head = (16u - ((uintptr_t)dst & 15u)) & 15u;
+  copy_rep(dst, src, head);
+  dst += head;
+  src += head;
+  n -= head;
+
+  size_t blocks = n >> 6;
+  if (blocks)
+  {
+    __asm__ __volatile__(
+        "1:\n\t"
+        "movdqu (%1), %%xmm0\n\t"
+        "movdqu 16(%1), %%xmm1\n\t"
+        "movdqu 32(%1), %%xmm2\n\t"
+        "movdqu 48(%1), %%xmm3\n\t"
+        "movdqa %%xmm0, (%0)\n\t"
+        "movdqa %%xmm1, 16(%0)\n\t"
+        "movdqa %%xmm2, 32(%0)\n\t"
+        "movdqa %%xmm3, 48(%0)\n\t"
+        "add $64, %0\n\t"
+        "add $64, %1\n\t"
+        "dec %2\n\t"
+        "jnz 1b"
+        : "+r"(dst), "+r"(src), "+r"(blocks)
+        :
+        : "memory");
+  }
+  copy_rep(dst, src, n & 63u);
+}
+
+void *memcpy(void *dst, const void *src, size_t n)
+{
+  if (simd_usable(n))
+  {
+    copy_sse2((uint8_t *)dst, (const uint8_t *)src, n);
+  }
+  else
+  {
+    copy_rep((uint8_t *)dst, (const uint8_t *)src, n);
+  }
+  return dst;
+}
+
+void *memmove(void *dst, const void *src, size_t n)
+{
+  uint8_t *d = (uint8_t *)dst;
+  const uint8_t *s = (const uint8_t *)src;
+  /* A forward copy is safe unless the destination starts inside the source. */
+  if (d <= s || d >= s + n)
+  {
+    return memcpy(dst, src, n);
+  }
+
+  d += n;
+  s += n;
+  size_t bytes = n & 3u;
+  size_t dwords = n >> 2;
+  d -= 1;
+  s -= 1;
+  __asm__ __volatile__("std\n\trep movsb\n\tcld" : "+D"(d), "+S"(s), "+c"(bytes) : : "memory");
+  d -= 3;
+  s -= 3;
+  __asm__ __volatile__("std\n\trep movsl\n\tcld" : "+D"(d), "+S"(s), "+c"(dwords) : : "memory");
+  return dst;
+}
+
+static void fill_rep(uint8_t *dst, uint32_t pattern, size_t n)
+{
+  size_t dwords = n >> 2;
+  size_t bytes = n & 3u;
+  __asm__ __volatile__("rep stosl" : "+D"(dst), "+c"(dwords) : "a"(pattern) : "memory");
+  __asm__ __volatile__("rep stosb" : "+D"(dst), "+c"(bytes) : "a"(pattern) : "memory");
+}
+
+static void fill_sse2(uint8_t *dst, uint32_t pattern, size_t n)
+{
+  size_t head = (16u - ((uintptr_t)dst & 15u)) & 15u;
+  fill_rep(dst, pattern, head);
+  dst += head;
+  n -= head;
+
+  size_t blocks = n >> 6;
+  if (blocks)
+  {
+    __asm__ __volatile__(
+        "movd %2, %%xmm0\n\t"
+        "pshufd $0, %%xmm0, %%xmm0\n\t"
+        "1:\n\t"
+        "movdqa %%xmm0, (%0)\n\t"
+        "movdqa %%xmm0, 16(%0)\n\t"
+        "movdqa %%xmm0, 32(%0)\n\t"
+        "movdqa %%xmm0, 48(%0)\n\t"
+        "add $64, %0\n\t"
+        "dec %1\n\t"
+        "jnz 1b"
+        : "+r"(dst), "+r"(blocks)
+        : "r"(pattern)
+        : "memory");
+  }
+  fill_rep(dst, pattern, n & 63u);
+}
+
+void *memset(void *dst, int value, size_t n)
+{
+  uint32_t pattern = (uint8_t)value * 0x01010101u;
+  if (simd_usable(n))
+  {
+    fill_sse2((uint8_t *)dst, pattern, n);
+  }
+  else
+  {
+    fill_rep((uint8_t *)dst, pattern, n);
+  }
+  return dst;
+}
+
+size_t strlen(const char *s)
+{
+  const char *p = s;
+  while ((uintptr_t)p & 3u)
+  {
+    if (*p == '\0')
+    {
+      return (size_t)(p - s);
+    }
+    p++;
+  }
+
+  /* A word holds a zero byte exactly when this leaves one of its high bits set. */
+  const string_word_t *word = (const string_word_t *)p;
+  while (!((*word - 0x01010101u) & ~*word & 0x80808080u))
+  {
+    word++;
+  }
+  p = (const char *)word;
+  size_t len = (size_t)(p - s);
+  if (p[0] == '\0')
+  {
+    return len;
+  }
+  if (p[1] == '\0')
+  {
+    return len + 1;
+  }
+  return p[2] == '\0' ? len + 2 : len + 3;
+}
+
+int strcmp(const char *a, const char *b)
+{
+  const unsigned char *pa = (const unsigned char *)a;
+  const unsigned char *pb = (const unsigned char *)b;
+  while (*pa != '\0' && *pa == *pb)
+  {
+    pa++;
+    pb++;
+  }
+  return (int)*pa - (int)*pb;
+}
+
+size_t str_copy(char *dst, size_t dst_len, const char *src)
+{
+  if (dst_len == 0)
+  {
+    return 0;
+  }
+  size_t len = src ? strlen(src) : 0;
+  if (len > dst_len - 1)
+  {
+    len = dst_len - 1;
+  }
+  memcpy(dst, src, len);
+  dst[len] = '\0';
+  return len;
+}
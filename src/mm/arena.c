@@ -0,0 +1,120 @@
+#include "mm/arena.h"
+#include "mm/heap.h"
+#include "mm/page.h"
+#include "mm/vmm.h"
+
+#define ARENA_ALIGN 8u
+/* Chunk came from kmalloc because the page allocator had nothing. */
+#define ARENA_ORDER_HEAP 0xFFu
+
+typedef struct arena_chunk
+{
+  struct arena_chunk *next;
+  size_t size;
+  size_t used;
+  uint8_t order;
+} arena_chunk_t;
+
+#define ARENA_HEADER ((sizeof(arena_chunk_t) + ARENA_ALIGN - 1) & ~(size_t)(ARENA_ALIGN - 1))
+
+static arena_chunk_t *chunk_create(size_t payload)
+{
+  size_t bytes = payload + ARENA_HEADER;
+  unsigned order = 0;
+  while (order <= PAGE_MAX_ORDER && ((size_t)PAGE_SIZE << order) < bytes)
+  {
+    order++;
+  }
+
+  arena_chunk_t *chunk = 0;
+  if (order <= PAGE_MAX_ORDER)
+  {
+    phys_addr_t frame = page_alloc(order);
+    if (frame)
+    {
+      chunk = (arena_chunk_t *)phys_to_virt(frame);
+      chunk->order = (uint8_t)order;
+      bytes = (size_t)PAGE_SIZE << order;
+    }
+  }
+  if (!chunk)
+  {
+    chunk = (arena_chunk_t *)kmalloc(bytes);
+    if (!chunk)
+    {
+      return 0;
+    }
+    chunk->order = ARENA_ORDER_HEAP;
+  }
+  chunk->next = 0;
+  chunk->size = bytes - ARENA_HEADER;
+  chunk->used = 0;
+  return chunk;
+}
+
+void arena_init(arena_t *arena)
+{
+  arena->chunks = 0;
+  arena->used = 0;
+  arena->reserved = 0;
+  spin_init(&arena->lock);
+}
+
+void *arena_alloc(arena_t *arena, size_t size)
+{
+  if (!arena)
+  {
+    return 0;
+  }
+  size = (size + ARENA_ALIGN - 1) & ~(size_t)(ARENA_ALIGN - 1);
+
+  /* Only the newest chunk is bumped; the tail of older ones is given up. */
+  uint32_t flags = spin_lock_irqsave(&arena->lock);
+  arena_chunk_t *chunk = arena->chunks;
+  if (!chunk || chunk->size - chunk->used < size)
+  {
+    chunk = chunk_create(size > ARENA_CHUNK_SIZE - ARENA_HEADER ? size : ARENA_CHUNK_SIZE - ARENA_HEADER);
+    if (!chunk)
+    {
+      spin_unlock_irqrestore(&arena->lock, flags);
+      return 0;
+    }
+    chunk->next = arena->chunks;
+    arena->chunks = chunk;
+    arena->reserved += chunk->size;
+  }
+
+  void *ptr = (uint8_t *)chunk + ARENA_HEADER + chunk->used;
+  chunk->used += size;
+  arena->used += size;
+  spin_unlock_irqrestore(&arena->lock, flags);
+  return ptr;
+}
+
+void arena_release(arena_t *arena)
+{
+  if (!arena)
+  {
+    return;
+  }
+  uint32_t flags = spin_lock_irqsave(&arena->lock);
+  arena_chunk_t *chunk = arena->chunks;
+  arena->chunks = 0;
+  arena->used = 0;
+  arena->reserved = 0;
+  spin_unlock_irqrestore(&arena->lock, flags);
+
+  while (chunk)
+  {
+    arena_chunk_t *next = chunk->next;
+    if (chunk->order == ARENA_ORDER_HEAP)
+    {
+      kfree(chunk);
+    }
+    else
+    {
+      page_free(virt_to_phys(chunk), chunk->order);
+    }
+    chunk = next;
+  }
+}
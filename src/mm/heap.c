@@ -1,135 +1,358 @@
 #include "mm/heap.h"
+#include "mm/heap_backend.h"
+#include "mm/slab.h"
+#include "mm/page.h"
+#include "mm/vmm.h"
+#include "arch/spinlock.h"
+#include "lib/string.h"
 #include <stdint.h>
 
-typedef struct heap_block
+/* Slab objects sit on 16-byte boundaries. */
+#define HEAP_SLAB_ALIGN 16u
+
+typedef struct
 {
+  uint8_t *base;
   size_t size;
-  int free;
-  struct heap_block *next;
-} heap_block_t;
+} heap_region_t;
+
+/* Only ever appended to, so heap_contains reads it without the lock. */
+static heap_region_t heap_regions[HEAP_MAX_REGIONS];
+static volatile uint32_t heap_region_count;
+static spinlock_t heap_grow_lock = SPINLOCK_INIT;
 
-static heap_block_t *heap_head;
-static size_t heap_total_bytes;
+/* Bytes live across the slab caches and the backend, and their high mark. */
+static volatile size_t heap_in_use;
+static volatile size_t heap_peak;
+static volatile uint32_t heap_allocations;
 
-static size_t align8(size_t size)
+typedef struct
 {
-  return (size + 7u) & ~7u;
-}
+  uint32_t samples;
+  uint32_t dropped_sites;
+  uint32_t size_buckets[HEAP_PROFILE_BUCKETS];
+  heap_profile_site_t sites[HEAP_PROFILE_SITES];
+} heap_profile_state_t;
+
+static heap_profile_state_t heap_profile;
+static spinlock_t heap_profile_lock = SPINLOCK_INIT;
 
 void heap_init(void *base, size_t size)
 {
-  heap_head = (heap_block_t *)base;
-  heap_head->size = size - sizeof(heap_block_t);
-  heap_head->free = 1;
-  heap_head->next = 0;
-  heap_total_bytes = size;
+  slab_init();
+  heap_regions[0].base = (uint8_t *)base;
+  heap_regions[0].size = size;
+  heap_region_count = 1;
+  heap_backend_init(base, size);
 }
 
-void *kmalloc(size_t size)
+static int heap_contains(const void *ptr)
 {
-  size = align8(size);
-  heap_block_t *current = heap_head;
-
-  while (current)
+  const uint8_t *p = (const uint8_t *)ptr;
+  uint32_t count = __atomic_load_n(&heap_region_count, __ATOMIC_ACQUIRE);
+  for (uint32_t i = 0; i < count; ++i)
   {
-    if (current->free && current->size >= size)
+    if (p >= heap_regions[i].base && p < heap_regions[i].base + heap_regions[i].size)
     {
-      if (current->size >= size + sizeof(heap_block_t) + 8)
-      {
-        heap_block_t *next = (heap_block_t *)((uint8_t *)current + sizeof(heap_block_t) + size);
-        next->size = current->size - size - sizeof(heap_block_t);
-        next->free = 1;
-        next->next = current->next;
-        current->next = next;
-        current->size = size;
-      }
-      current->free = 0;
-      return (uint8_t *)current + sizeof(heap_block_t);
+      return 1;
     }
-    current = current->next;
+  }
+  return 0;
+}
+
+/* Adds a region from the page allocator big enough for a block of size bytes. */
+static int heap_grow(size_t size, size_t align)
+{
+  size_t need = heap_backend_region_size(size, align);
+  unsigned order = HEAP_GROW_MIN_ORDER;
+  while (order <= PAGE_MAX_ORDER && ((size_t)PAGE_SIZE << order) < need)
+  {
+    order++;
+  }
+  if (need < size || order > PAGE_MAX_ORDER)
+  {
+    return -1;
   }
 
+  uint32_t flags = spin_lock_irqsave(&heap_grow_lock);
+  uint32_t count = heap_region_count;
+  phys_addr_t frame = count < HEAP_MAX_REGIONS ? page_alloc(order) : 0;
+  if (!frame)
+  {
+    spin_unlock_irqrestore(&heap_grow_lock, flags);
+    return -1;
+  }
+  heap_regions[count].base = (uint8_t *)phys_to_virt(frame);
+  heap_regions[count].size = (size_t)PAGE_SIZE << order;
+  __atomic_store_n(&heap_region_count, count + 1, __ATOMIC_RELEASE);
+  heap_backend_add_region(heap_regions[count].base, heap_regions[count].size);
+  spin_unlock_irqrestore(&heap_grow_lock, flags);
   return 0;
 }
 
-void kfree(void *ptr)
+static uint32_t size_bucket(size_t size)
 {
-  if (!ptr)
+  uint32_t bucket = 0;
+  while (bucket < HEAP_PROFILE_BUCKETS - 1 && ((size_t)16 << bucket) < size)
   {
-    return;
+    bucket++;
   }
+  return bucket;
+}
 
-  heap_block_t *block = (heap_block_t *)((uint8_t *)ptr - sizeof(heap_block_t));
-  block->free = 1;
+static void profile_sample(uintptr_t site, size_t size)
+{
+  uint32_t flags = spin_lock_irqsave(&heap_profile_lock);
+  heap_profile.samples++;
+  heap_profile.size_buckets[size_bucket(size)]++;
 
-  heap_block_t *current = heap_head;
-  while (current && current->next)
+  /* Open addressing on the return address; a full table just counts drops. */
+  uint32_t slot = (uint32_t)(site >> 2) % HEAP_PROFILE_SITES;
+  for (uint32_t probe = 0; probe < HEAP_PROFILE_SITES; ++probe)
   {
-    if (current->free && current->next->free)
+    heap_profile_site_t *entry = &heap_profile.sites[(slot + probe) % HEAP_PROFILE_SITES];
+    if (entry->site == site || entry->site == 0)
     {
-      current->size += sizeof(heap_block_t) + current->next->size;
-      current->next = current->next->next;
-      continue;
+      entry->site = site;
+      entry->samples++;
+      entry->bytes += size;
+      spin_unlock_irqrestore(&heap_profile_lock, flags);
+      return;
     }
-    current = current->next;
   }
+  heap_profile.dropped_sites++;
+  spin_unlock_irqrestore(&heap_profile_lock, flags);
 }
 
-void heap_get_stats(heap_stats_t *out)
+static void account_alloc(size_t size)
 {
-  if (!out)
+  size_t in_use = __atomic_add_fetch(&heap_in_use, size, __ATOMIC_RELAXED);
+  size_t peak = heap_peak;
+  while (in_use > peak &&
+         !__atomic_compare_exchange_n(&heap_peak, &peak, in_use, 0, __ATOMIC_RELAXED, __ATOMIC_RELAXED))
   {
-    return;
   }
+}
 
-  size_t used = 0;
-  size_t free = 0;
-  size_t blocks = 0;
-  size_t free_blocks = 0;
-  size_t largest_free = 0;
+static void *backend_alloc(size_t size, size_t align)
+{
+  void *ptr = align ? heap_backend_alloc_aligned(size, align) : heap_backend_alloc(size);
+  if (!ptr && heap_grow(size, align) == 0)
+  {
+    ptr = align ? heap_backend_alloc_aligned(size, align) : heap_backend_alloc(size);
+  }
+  return ptr;
+}
+
+/* align 0 means the backend's natural 8 bytes. */
+static void *heap_alloc(size_t size, size_t align, uintptr_t site)
+{
+  /* Small objects come from the slab caches; the backend takes the rest. */
+  void *ptr = 0;
+  size_t granted = 0;
+  if (size <= SLAB_MAX_SIZE && align <= HEAP_SLAB_ALIGN)
+  {
+    ptr = slab_alloc(size);
+    granted = ptr ? slab_object_size(ptr) : 0;
+  }
+  if (!ptr)
+  {
+    ptr = backend_alloc(size, align);
+    if (!ptr)
+    {
+      return 0;
+    }
+    granted = heap_backend_block_size(ptr);
+  }
+
+  account_alloc(granted);
+  uint32_t count = __atomic_add_fetch(&heap_allocations, 1u, __ATOMIC_RELAXED);
+  if (count % HEAP_PROFILE_SAMPLE_EVERY == 0)
+  {
+    profile_sample(site, granted);
+  }
+  return ptr;
+}
+
+void *kmalloc(size_t size)
+{
+  return heap_alloc(size, 0, (uintptr_t)__builtin_return_address(0));
+}
+
+void *kmalloc_aligned(size_t size, size_t align)
+{
+  if (align == 0 || (align & (align - 1)) != 0)
+  {
+    return 0;
+  }
+  return heap_alloc(size, align > 8 ? align : 0, (uintptr_t)__builtin_return_address(0));
+}
+
+void *krealloc(void *ptr, size_t size)
+{
+  if (!ptr)
+  {
+    return heap_alloc(size, 0, (uintptr_t)__builtin_return_address(0));
+  }
+  if (size == 0)
+  {
+    kfree(ptr);
+    return 0;
+  }
 
-  heap_block_t *current = heap_head;
-  while (current)
+  size_t old_size;
+  if (heap_contains(ptr))
   {
-    blocks++;
-    if (current->free)
+    old_size = heap_backend_block_size(ptr);
+    if (heap_backend_resize(ptr, size) == 0)
     {
-      free_blocks++;
-      free += current->size;
-      if (current->size > largest_free)
+      size_t new_size = heap_backend_block_size(ptr);
+      if (new_size >= old_size)
       {
-        largest_free = current->size;
+        account_alloc(new_size - old_size);
       }
+      else
+      {
+        __atomic_sub_fetch(&heap_in_use, old_size - new_size, __ATOMIC_RELAXED);
+      }
+      return ptr;
     }
-    else
+  }
+  else
+  {
+    /* A slab object can only stay put while it still fits its class. */
+    old_size = slab_object_size(ptr);
+    if (size <= old_size)
     {
-      used += current->size;
+      return ptr;
     }
-    current = current->next;
   }
 
-  out->total_bytes = heap_total_bytes;
-  out->used_bytes = used;
-  out->free_bytes = free;
-  if (heap_total_bytes > 0)
+  void *moved = heap_alloc(size, 0, (uintptr_t)__builtin_return_address(0));
+  if (!moved)
+  {
+    return 0;
+  }
+  memcpy(moved, ptr, old_size < size ? old_size : size);
+  kfree(ptr);
+  return moved;
+}
+
+void kfree(void *ptr)
+{
+  if (!ptr)
   {
-    out->used_percent = (used * 100u) / heap_total_bytes;
-    out->free_percent = (free * 100u) / heap_total_bytes;
+    return;
+  }
+  size_t released = heap_contains(ptr) ? heap_backend_free(ptr) : slab_free(ptr);
+  __atomic_sub_fetch(&heap_in_use, released, __ATOMIC_RELAXED);
+}
+
+void heap_get_stats(heap_stats_t *out)
+{
+  if (!out)
+  {
+    return;
+  }
+
+  heap_backend_stats(out);
+  out->regions = __atomic_load_n(&heap_region_count, __ATOMIC_ACQUIRE);
+  size_t total = out->total_bytes;
+  if (total > 0)
+  {
+    out->used_percent = (out->used_bytes * 100u) / total;
+    out->free_percent = (out->free_bytes * 100u) / total;
   }
   else
   {
     out->used_percent = 0;
     out->free_percent = 0;
   }
-  if (free > 0)
+  if (out->free_bytes > 0)
   {
-    out->frag_percent = (size_t)(100u - ((largest_free * 100u) / free));
+    out->frag_percent = (size_t)(100u - ((out->largest_free * 100u) / out->free_bytes));
   }
   else
   {
     out->frag_percent = 0;
   }
-  out->blocks = blocks;
-  out->free_blocks = free_blocks;
-  out->largest_free = largest_free;
+}
+
+void heap_profile_get(heap_profile_t *out)
+{
+  if (!out)
+  {
+    return;
+  }
+
+  uint32_t flags = spin_lock_irqsave(&heap_profile_lock);
+  out->allocations = heap_allocations;
+  out->samples = heap_profile.samples;
+  out->dropped_sites = heap_profile.dropped_sites;
+  out->in_use = heap_in_use;
+  out->peak = heap_peak;
+  for (uint32_t i = 0; i < HEAP_PROFILE_BUCKETS; ++i)
+  {
+    out->size_buckets[i] = heap_profile.size_buckets[i];
+  }
+  spin_unlock_irqrestore(&heap_profile_lock, flags);
+}
+
+size_t heap_profile_top(heap_profile_site_t *out, size_t max)
+{
+  if (!out)
+  {
+    return 0;
+  }
+
+  /* Insertion sort into the caller's buffer; the table is tiny. */
+  size_t count = 0;
+  uint32_t flags = spin_lock_irqsave(&heap_profile_lock);
+  for (uint32_t i = 0; i < HEAP_PROFILE_SITES; ++i)
+  {
+    const heap_profile_site_t *entry = &heap_profile.sites[i];
+    if (entry->site == 0)
+    {
+      continue;
+    }
+    size_t pos = count < max ? count : max;
+    while (pos > 0 && out[pos - 1].bytes < entry->bytes)
+    {
+      if (pos < max)
+      {
+        out[pos] = out[pos - 1];
+      }
+      pos--;
+    }
+    if (pos < max)
+    {
+      out[pos] = *entry;
+      if (count < max)
+      {
+        count++;
+      }
+    }
+  }
+  spin_unlock_irqrestore(&heap_profile_lock, flags);
+  return count;
+}
+
+void heap_profile_reset(void)
+{
+  uint32_t flags = spin_lock_irqsave(&heap_profile_lock);
+  heap_profile.samples = 0;
+  heap_profile.dropped_sites = 0;
+  for (uint32_t i = 0; i < HEAP_PROFILE_BUCKETS; ++i)
+  {
+    heap_profile.size_buckets[i] = 0;
+  }
+  for (uint32_t i = 0; i < HEAP_PROFILE_SITES; ++i)
+  {
+    heap_profile.sites[i].site = 0;
+    heap_profile.sites[i].samples = 0;
+    heap_profile.sites[i].bytes = 0;
+  }
+  heap_allocations = 0;
+  heap_peak = heap_in_use;
+  spin_unlock_irqrestore(&heap_profile_lock, flags);
 }
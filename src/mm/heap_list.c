@@ -0,0 +1,295 @@
+#include "mm/heap_backend.h"
+#include "arch/spinlock.h"
+#include <stdint.h>
+
+/*
+ * First-fit backend: one singly linked list of blocks in address order.
+ * Allocation walks to the first fit and kfree walks the list to merge.
+ * Regions need not touch, so only physically adjacent blocks are merged.
+ */
+
+/* Padded to 8 bytes so payloads stay 8-byte aligned. */
+typedef struct heap_block
+{
+  size_t size;
+  int free;
+  struct heap_block *next;
+} __attribute__((aligned(8))) heap_block_t;
+
+static heap_block_t *heap_head;
+static size_t heap_total_bytes;
+/* Kept current by alloc and free so stats never walk the list. */
+static size_t heap_used_bytes;
+static size_t heap_free_bytes;
+static size_t heap_blocks;
+static size_t heap_free_blocks;
+static size_t heap_largest_free;
+static spinlock_t heap_lock = SPINLOCK_INIT;
+
+static size_t align8(size_t size)
+{
+  return (size + 7u) & ~7u;
+}
+
+static size_t largest_free_block(void)
+{
+  size_t largest = 0;
+  for (heap_block_t *current = heap_head; current; current = current->next)
+  {
+    if (current->free && current->size > largest)
+    {
+      largest = current->size;
+    }
+  }
+  return largest;
+}
+
+static int blocks_adjacent(const heap_block_t *block, const heap_block_t *next)
+{
+  return (const uint8_t *)block + sizeof(heap_block_t) + block->size == (const uint8_t *)next;
+}
+
+/* Splits the tail past size off a block as a new free block. */
+static void split_tail(heap_block_t *block, size_t size)
+{
+  heap_block_t *rest = (heap_block_t *)((uint8_t *)block + sizeof(heap_block_t) + size);
+  rest->size = block->size - size - sizeof(heap_block_t);
+  rest->free = 1;
+  rest->next = block->next;
+  block->next = rest;
+  block->size = size;
+  heap_blocks++;
+  heap_free_blocks++;
+}
+
+/* Hands out size bytes from the front of a free block. */
+static void take_block(heap_block_t *current, size_t size)
+{
+  size_t taken_from = current->size;
+  heap_free_blocks--;
+  heap_free_bytes -= current->size;
+  if (current->size >= size + sizeof(heap_block_t) + 8)
+  {
+    split_tail(current, size);
+    heap_free_bytes += current->next->size;
+  }
+  current->free = 0;
+  heap_used_bytes += current->size;
+  /* Only carving up the largest block can change the largest. */
+  if (taken_from == heap_largest_free)
+  {
+    heap_largest_free = largest_free_block();
+  }
+}
+
+void heap_backend_init(void *base, size_t size)
+{
+  heap_head = 0;
+  heap_total_bytes = 0;
+  heap_used_bytes = 0;
+  heap_free_bytes = 0;
+  heap_blocks = 0;
+  heap_free_blocks = 0;
+  heap_largest_free = 0;
+  heap_backend_add_region(base, size);
+}
+
+void heap_backend_add_region(void *base, size_t size)
+{
+  uintptr_t start = ((uintptr_t)base + 7u) & ~(uintptr_t)7u;
+  size -= start - (uintptr_t)base;
+  heap_block_t *block = (heap_block_t *)start;
+  block->size = (size - sizeof(heap_block_t)) & ~(size_t)7u;
+  block->free = 1;
+
+  uint32_t flags = spin_lock_irqsave(&heap_lock);
+  heap_block_t **link = &heap_head;
+  while (*link && *link < block)
+  {
+    link = &(*link)->next;
+  }
+  block->next = *link;
+  *link = block;
+  heap_total_bytes += size;
+  heap_free_bytes += block->size;
+  heap_blocks++;
+  heap_free_blocks++;
+  if (block->size > heap_largest_free)
+  {
+    heap_largest_free = block->size;
+  }
+  spin_unlock_irqrestore(&heap_lock, flags);
+}
+
+size_t heap_backend_region_size(size_t size, size_t align)
+{
+  size_t need = align8(size) + sizeof(heap_block_t) + 7u;
+  if (align)
+  {
+    /* Room to leave a skipped front behind as a free block. */
+    need += align + sizeof(heap_block_t) + 8u;
+  }
+  return need;
+}
+
+void *heap_backend_alloc(size_t size)
+{
+  size = align8(size);
+  uint32_t flags = spin_lock_irqsave(&heap_lock);
+  for (heap_block_t *current = heap_head; current; current = current->next)
+  {
+    if (current->free && current->size >= size)
+    {
+      take_block(current, size);
+      spin_unlock_irqrestore(&heap_lock, flags);
+      return (uint8_t *)current + sizeof(heap_block_t);
+    }
+  }
+
+  spin_unlock_irqrestore(&heap_lock, flags);
+  return 0;
+}
+
+void *heap_backend_alloc_aligned(size_t size, size_t align)
+{
+  size = align8(size);
+  uint32_t flags = spin_lock_irqsave(&heap_lock);
+  for (heap_block_t *current = heap_head; current; current = current->next)
+  {
+    if (!current->free)
+    {
+      continue;
+    }
+    /* A skipped front must be big enough to stay behind as a free block. */
+    uintptr_t payload = (uintptr_t)current + sizeof(heap_block_t);
+    uintptr_t aligned = (payload + align - 1) & ~(uintptr_t)(align - 1);
+    while (aligned != payload && aligned - payload < sizeof(heap_block_t) + 8)
+    {
+      aligned += align;
+    }
+    if (aligned - payload > current->size || current->size - (aligned - payload) < size)
+    {
+      continue;
+    }
+
+    if (aligned != payload)
+    {
+      split_tail(current, aligned - payload - sizeof(heap_block_t));
+      heap_free_bytes -= sizeof(heap_block_t);
+      current = current->next;
+    }
+    take_block(current, size);
+    heap_largest_free = largest_free_block();
+    spin_unlock_irqrestore(&heap_lock, flags);
+    return (uint8_t *)current + sizeof(heap_block_t);
+  }
+
+  spin_unlock_irqrestore(&heap_lock, flags);
+  return 0;
+}
+
+int heap_backend_resize(void *ptr, size_t size)
+{
+  heap_block_t *block = (heap_block_t *)((uint8_t *)ptr - sizeof(heap_block_t));
+  size = align8(size);
+
+  uint32_t flags = spin_lock_irqsave(&heap_lock);
+  if (block->free)
+  {
+    spin_unlock_irqrestore(&heap_lock, flags);
+    return -1;
+  }
+  heap_block_t *next = block->next;
+  if (size > block->size)
+  {
+    if (!next || !next->free || !blocks_adjacent(block, next) ||
+        block->size + sizeof(heap_block_t) + next->size < size)
+    {
+      spin_unlock_irqrestore(&heap_lock, flags);
+      return -1;
+    }
+    /* Swallow the free neighbour, then give back what is not needed. */
+    heap_used_bytes += sizeof(heap_block_t) + next->size;
+    heap_free_bytes -= next->size;
+    block->size += sizeof(heap_block_t) + next->size;
+    block->next = next->next;
+    heap_blocks--;
+    heap_free_blocks--;
+    next = block->next;
+  }
+  if (block->size >= size + sizeof(heap_block_t) + 8)
+  {
+    heap_used_bytes -= block->size - size;
+    split_tail(block, size);
+    heap_block_t *rest = block->next;
+    heap_free_bytes += rest->size;
+    if (next && next->free && blocks_adjacent(rest, next))
+    {
+      rest->size += sizeof(heap_block_t) + next->size;
+      rest->next = next->next;
+      heap_blocks--;
+      heap_free_blocks--;
+      heap_free_bytes += sizeof(heap_block_t);
+    }
+  }
+  heap_largest_free = largest_free_block();
+  spin_unlock_irqrestore(&heap_lock, flags);
+  return 0;
+}
+
+size_t heap_backend_block_size(const void *ptr)
+{
+  return ((const heap_block_t *)((const uint8_t *)ptr - sizeof(heap_block_t)))->size;
+}
+
+size_t heap_backend_free(void *ptr)
+{
+  uint32_t flags = spin_lock_irqsave(&heap_lock);
+  heap_block_t *block = (heap_block_t *)((uint8_t *)ptr - sizeof(heap_block_t));
+  if (block->free)
+  {
+    spin_unlock_irqrestore(&heap_lock, flags);
+    return 0;
+  }
+  size_t size = block->size;
+  block->free = 1;
+  heap_used_bytes -= size;
+  heap_free_bytes += size;
+  heap_free_blocks++;
+
+  /* The merge pass already visits every block, so it refreshes the largest. */
+  size_t largest = 0;
+  heap_block_t *current = heap_head;
+  while (current)
+  {
+    if (current->free && current->next && current->next->free && blocks_adjacent(current, current->next))
+    {
+      current->size += sizeof(heap_block_t) + current->next->size;
+      current->next = current->next->next;
+      heap_blocks--;
+      heap_free_blocks--;
+      heap_free_bytes += sizeof(heap_block_t);
+      continue;
+    }
+    if (current->free && current->size > largest)
+    {
+      largest = current->size;
+    }
+    current = current->next;
+  }
+  heap_largest_free = largest;
+  spin_unlock_irqrestore(&heap_lock, flags);
+  return size;
+}
+
+void heap_backend_stats(heap_stats_t *out)
+{
+  uint32_t flags = spin_lock_irqsave(&heap_lock);
+  out->total_bytes = heap_total_bytes;
+  out->used_bytes = heap_used_bytes;
+  out->free_bytes = heap_free_bytes;
+  out->blocks = heap_blocks;
+  out->free_blocks = heap_free_blocks;
+  out->largest_free = heap_largest_free;
+  spin_unlock_irqrestore(&heap_lock, flags);
+}
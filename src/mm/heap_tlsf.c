@@ -0,0 +1,437 @@
+#include "mm/heap_backend.h"
+#include "arch/spinlock.h"
+#include <stdint.h>
+
+/*
+ * Two-level segregated fit backend. Free blocks are binned by the position
+ * of their top bit (first level) and the next TLSF_SL_LOG2 bits (second
+ * level); two bitmaps find a non-empty bin with a couple of bit scans.
+ * Every block records its physical predecessor (a boundary tag), so freeing
+ * merges with both neighbours without walking anything. Each region ends in
+ * a zero-size used sentinel, so merging never runs off the end of one.
+ */
+
+#define TLSF_ALIGN 8u
+#define TLSF_SL_LOG2 4
+#define TLSF_SL_COUNT (1u << TLSF_SL_LOG2)
+#define TLSF_FL_SHIFT (TLSF_SL_LOG2 + 3)
+#define TLSF_SMALL_BLOCK (1u << TLSF_FL_SHIFT)
+#define TLSF_FL_MAX 30
+#define TLSF_FL_COUNT (TLSF_FL_MAX - TLSF_FL_SHIFT + 1)
+#define TLSF_BLOCK_FREE 1u
+#define TLSF_SIZE_MASK (~(size_t)(TLSF_ALIGN - 1))
+
+typedef struct tlsf_block
+{
+  struct tlsf_block *prev_phys;
+  /* Payload size; bit 0 is set while the block is free. */
+  size_t size;
+  /* Free-list links live in the payload, so only exist while free. */
+  struct tlsf_block *next_free;
+  struct tlsf_block *prev_free;
+} tlsf_block_t;
+
+#define TLSF_HEADER (sizeof(struct tlsf_block *) + sizeof(size_t))
+#define TLSF_MIN_PAYLOAD (sizeof(tlsf_block_t) - TLSF_HEADER)
+
+static uint32_t tlsf_fl_bitmap;
+static uint32_t tlsf_sl_bitmap[TLSF_FL_COUNT];
+static tlsf_block_t *tlsf_bins[TLSF_FL_COUNT][TLSF_SL_COUNT];
+static size_t tlsf_total_bytes;
+static size_t tlsf_used_bytes;
+static size_t tlsf_free_bytes;
+static size_t tlsf_blocks;
+static size_t tlsf_free_blocks;
+static spinlock_t tlsf_lock = SPINLOCK_INIT;
+
+static uint32_t fls32(uint32_t value)
+{
+  return 31u - (uint32_t)__builtin_clz(value);
+}
+
+static uint32_t ffs32(uint32_t value)
+{
+  return (uint32_t)__builtin_ctz(value);
+}
+
+static size_t block_size(const tlsf_block_t *block)
+{
+  return block->size & TLSF_SIZE_MASK;
+}
+
+static int block_is_free(const tlsf_block_t *block)
+{
+  return (block->size & TLSF_BLOCK_FREE) != 0;
+}
+
+static tlsf_block_t *block_next(const tlsf_block_t *block)
+{
+  return (tlsf_block_t *)((uint8_t *)block + TLSF_HEADER + block_size(block));
+}
+
+static void mapping_insert(size_t size, uint32_t *fl, uint32_t *sl)
+{
+  if (size < TLSF_SMALL_BLOCK)
+  {
+    *fl = 0;
+    *sl = (uint32_t)size / (TLSF_SMALL_BLOCK / TLSF_SL_COUNT);
+    return;
+  }
+  uint32_t top = fls32((uint32_t)size);
+  *sl = (uint32_t)(size >> (top - TLSF_SL_LOG2)) ^ TLSF_SL_COUNT;
+  *fl = top - (TLSF_FL_SHIFT - 1);
+}
+
+/* Rounds up to the next bin boundary so any block found there fits. */
+static void mapping_search(size_t size, uint32_t *fl, uint32_t *sl)
+{
+  if (size >= TLSF_SMALL_BLOCK)
+  {
+    size += ((size_t)1 << (fls32((uint32_t)size) - TLSF_SL_LOG2)) - 1;
+  }
+  mapping_insert(size, fl, sl);
+}
+
+static void bin_insert(tlsf_block_t *block)
+{
+  uint32_t fl, sl;
+  mapping_insert(block_size(block), &fl, &sl);
+  block->prev_free = 0;
+  block->next_free = tlsf_bins[fl][sl];
+  if (block->next_free)
+  {
+    block->next_free->prev_free = block;
+  }
+  tlsf_bins[fl][sl] = block;
+  tlsf_fl_bitmap |= 1u << fl;
+  tlsf_sl_bitmap[fl] |= 1u << sl;
+}
+
+static void bin_remove(tlsf_block_t *block)
+{
+  uint32_t fl, sl;
+  mapping_insert(block_size(block), &fl, &sl);
+  if (block->prev_free)
+  {
+    block->prev_free->next_free = block->next_free;
+  }
+  else
+  {
+    tlsf_bins[fl][sl] = block->next_free;
+    if (!tlsf_bins[fl][sl])
+    {
+      tlsf_sl_bitmap[fl] &= ~(1u << sl);
+      if (!tlsf_sl_bitmap[fl])
+      {
+        tlsf_fl_bitmap &= ~(1u << fl);
+      }
+    }
+  }
+  if (block->next_free)
+  {
+    block->next_free->prev_free = block->prev_free;
+  }
+}
+
+static tlsf_block_t *bin_find(size_t size)
+{
+  uint32_t fl, sl;
+  mapping_search(size, &fl, &sl);
+  if (fl >= TLSF_FL_COUNT)
+  {
+    return 0;
+  }
+
+  uint32_t sl_map = tlsf_sl_bitmap[fl] & (~0u << sl);
+  if (!sl_map)
+  {
+    uint32_t fl_map = fl + 1 < TLSF_FL_COUNT ? tlsf_fl_bitmap & (~0u << (fl + 1)) : 0;
+    if (!fl_map)
+    {
+      return 0;
+    }
+    fl = ffs32(fl_map);
+    sl_map = tlsf_sl_bitmap[fl];
+  }
+  return tlsf_bins[fl][ffs32(sl_map)];
+}
+
+/*
+ * Gives the leftover past size back as a free block, merged with the next
+ * block if that one is free too. The block must be live and locked.
+ */
+static void block_trim(tlsf_block_t *block, size_t size)
+{
+  size_t available = block_size(block);
+  if (available < size + TLSF_HEADER + TLSF_MIN_PAYLOAD)
+  {
+    return;
+  }
+  tlsf_block_t *rest = (tlsf_block_t *)((uint8_t *)block + TLSF_HEADER + size);
+  rest->prev_phys = block;
+  rest->size = available - size - TLSF_HEADER;
+  block->size = size;
+  tlsf_used_bytes -= available - size;
+  tlsf_free_bytes += rest->size;
+  tlsf_blocks++;
+  tlsf_free_blocks++;
+
+  tlsf_block_t *next = block_next(rest);
+  if (block_is_free(next))
+  {
+    bin_remove(next);
+    rest->size += TLSF_HEADER + block_size(next);
+    tlsf_blocks--;
+    tlsf_free_blocks--;
+    tlsf_free_bytes += TLSF_HEADER;
+  }
+  rest->size |= TLSF_BLOCK_FREE;
+  block_next(rest)->prev_phys = rest;
+  bin_insert(rest);
+}
+
+/* Takes a free block off its bin as one live block of its full size. */
+static void block_claim(tlsf_block_t *block)
+{
+  bin_remove(block);
+  block->size = block_size(block);
+  tlsf_free_blocks--;
+  tlsf_free_bytes -= block->size;
+  tlsf_used_bytes += block->size;
+}
+
+static size_t request_size(size_t size)
+{
+  if (size < TLSF_MIN_PAYLOAD)
+  {
+    size = TLSF_MIN_PAYLOAD;
+  }
+  return (size + TLSF_ALIGN - 1) & TLSF_SIZE_MASK;
+}
+
+void heap_backend_init(void *base, size_t size)
+{
+  tlsf_total_bytes = 0;
+  tlsf_used_bytes = 0;
+  tlsf_free_bytes = 0;
+  tlsf_blocks = 0;
+  tlsf_free_blocks = 0;
+  tlsf_fl_bitmap = 0;
+  for (uint32_t fl = 0; fl < TLSF_FL_COUNT; ++fl)
+  {
+    tlsf_sl_bitmap[fl] = 0;
+    for (uint32_t sl = 0; sl < TLSF_SL_COUNT; ++sl)
+    {
+      tlsf_bins[fl][sl] = 0;
+    }
+  }
+  heap_backend_add_region(base, size);
+}
+
+void heap_backend_add_region(void *base, size_t size)
+{
+  uintptr_t start = ((uintptr_t)base + TLSF_ALIGN - 1) & ~(uintptr_t)(TLSF_ALIGN - 1);
+  size -= start - (uintptr_t)base;
+
+  /* One free block spanning the region, then a zero-size used sentinel. */
+  tlsf_block_t *block = (tlsf_block_t *)start;
+  block->prev_phys = 0;
+  block->size = ((size - 2 * TLSF_HEADER) & TLSF_SIZE_MASK) | TLSF_BLOCK_FREE;
+  tlsf_block_t *sentinel = block_next(block);
+  sentinel->prev_phys = block;
+  sentinel->size = 0;
+
+  uint32_t flags = spin_lock_irqsave(&tlsf_lock);
+  bin_insert(block);
+  tlsf_total_bytes += size;
+  tlsf_free_bytes += block_size(block);
+  tlsf_blocks++;
+  tlsf_free_blocks++;
+  spin_unlock_irqrestore(&tlsf_lock, flags);
+}
+
+size_t heap_backend_region_size(size_t size, size_t align)
+{
+  size = request_size(size);
+  if (align)
+  {
+    size += align + TLSF_HEADER + TLSF_MIN_PAYLOAD;
+  }
+  /* bin_find only looks from the bin above, so the block must reach its floor. */
+  if (size >= TLSF_SMALL_BLOCK)
+  {
+    size += ((size_t)1 << (fls32((uint32_t)size) - TLSF_SL_LOG2)) - 1;
+    size &= ~(((size_t)1 << (fls32((uint32_t)size) - TLSF_SL_LOG2)) - 1);
+  }
+  return size + 2 * TLSF_HEADER + TLSF_ALIGN - 1;
+}
+
+void *heap_backend_alloc(size_t size)
+{
+  size = request_size(size);
+  if (size >= ((size_t)1 << TLSF_FL_MAX))
+  {
+    return 0;
+  }
+
+  uint32_t flags = spin_lock_irqsave(&tlsf_lock);
+  tlsf_block_t *block = bin_find(size);
+  if (!block)
+  {
+    spin_unlock_irqrestore(&tlsf_lock, flags);
+    return 0;
+  }
+  block_claim(block);
+  block_trim(block, size);
+  spin_unlock_irqrestore(&tlsf_lock, flags);
+  return (uint8_t *)block + TLSF_HEADER;
+}
+
+void *heap_backend_alloc_aligned(size_t size, size_t align)
+{
+  size = request_size(size);
+  /* Enough slack to move the payload up to alignment behind a free block. */
+  size_t search = size + align + TLSF_HEADER + TLSF_MIN_PAYLOAD;
+  if (search >= ((size_t)1 << TLSF_FL_MAX))
+  {
+    return 0;
+  }
+
+  uint32_t flags = spin_lock_irqsave(&tlsf_lock);
+  tlsf_block_t *block = bin_find(search);
+  if (!block)
+  {
+    spin_unlock_irqrestore(&tlsf_lock, flags);
+    return 0;
+  }
+  block_claim(block);
+
+  uintptr_t payload = (uintptr_t)block + TLSF_HEADER;
+  uintptr_t aligned = (payload + align - 1) & ~(uintptr_t)(align - 1);
+  while (aligned != payload && aligned - payload < TLSF_HEADER + TLSF_MIN_PAYLOAD)
+  {
+    aligned += align;
+  }
+  if (aligned != payload)
+  {
+    /* The skipped front of the block goes back as a free block of its own. */
+    size_t gap = aligned - payload - TLSF_HEADER;
+    tlsf_block_t *moved = (tlsf_block_t *)(aligned - TLSF_HEADER);
+    moved->prev_phys = block;
+    moved->size = block_size(block) - gap - TLSF_HEADER;
+    block_next(moved)->prev_phys = moved;
+    block->size = gap | TLSF_BLOCK_FREE;
+    bin_insert(block);
+    tlsf_used_bytes -= gap + TLSF_HEADER;
+    tlsf_free_bytes += gap;
+    tlsf_blocks++;
+    tlsf_free_blocks++;
+    block = moved;
+  }
+  block_trim(block, size);
+  spin_unlock_irqrestore(&tlsf_lock, flags);
+  return (uint8_t *)block + TLSF_HEADER;
+}
+
+int heap_backend_resize(void *ptr, size_t size)
+{
+  tlsf_block_t *block = (tlsf_block_t *)((uint8_t *)ptr - TLSF_HEADER);
+  size = request_size(size);
+
+  uint32_t flags = spin_lock_irqsave(&tlsf_lock);
+  if (block_is_free(block))
+  {
+    spin_unlock_irqrestore(&tlsf_lock, flags);
+    return -1;
+  }
+  if (size > block_size(block))
+  {
+    /* Growing in place needs a free neighbour right behind the block. */
+    tlsf_block_t *next = block_next(block);
+    if (!block_is_free(next) || block_size(block) + TLSF_HEADER + block_size(next) < size)
+    {
+      spin_unlock_irqrestore(&tlsf_lock, flags);
+      return -1;
+    }
+    block_claim(next);
+    block->size += TLSF_HEADER + next->size;
+    block_next(block)->prev_phys = block;
+    tlsf_used_bytes += TLSF_HEADER;
+    tlsf_blocks--;
+  }
+  block_trim(block, size);
+  spin_unlock_irqrestore(&tlsf_lock, flags);
+  return 0;
+}
+
+size_t heap_backend_block_size(const void *ptr)
+{
+  return block_size((const tlsf_block_t *)((const uint8_t *)ptr - TLSF_HEADER));
+}
+
+size_t heap_backend_free(void *ptr)
+{
+  tlsf_block_t *block = (tlsf_block_t *)((uint8_t *)ptr - TLSF_HEADER);
+
+  uint32_t flags = spin_lock_irqsave(&tlsf_lock);
+  if (block_is_free(block))
+  {
+    spin_unlock_irqrestore(&tlsf_lock, flags);
+    return 0;
+  }
+  size_t size = block_size(block);
+  tlsf_used_bytes -= size;
+  tlsf_free_bytes += size;
+  tlsf_free_blocks++;
+
+  tlsf_block_t *prev = block->prev_phys;
+  if (prev && block_is_free(prev))
+  {
+    bin_remove(prev);
+    prev->size = block_size(prev) + TLSF_HEADER + block_size(block);
+    block = prev;
+    tlsf_blocks--;
+    tlsf_free_blocks--;
+    tlsf_free_bytes += TLSF_HEADER;
+  }
+  tlsf_block_t *next = block_next(block);
+  if (block_is_free(next))
+  {
+    bin_remove(next);
+    block->size = block_size(block) + TLSF_HEADER + block_size(next);
+    tlsf_blocks--;
+    tlsf_free_blocks--;
+    tlsf_free_bytes += TLSF_HEADER;
+  }
+  block->size |= TLSF_BLOCK_FREE;
+  block_next(block)->prev_phys = block;
+  bin_insert(block);
+  spin_unlock_irqrestore(&tlsf_lock, flags);
+  return size;
+}
+
+void heap_backend_stats(heap_stats_t *out)
+{
+  uint32_t flags = spin_lock_irqsave(&tlsf_lock);
+  /* The largest free block sits in the highest non-empty bin. */
+  size_t largest_free = 0;
+  if (tlsf_fl_bitmap)
+  {
+    uint32_t fl = fls32(tlsf_fl_bitmap);
+    uint32_t sl = fls32(tlsf_sl_bitmap[fl]);
+    for (tlsf_block_t *block = tlsf_bins[fl][sl]; block; block = block->next_free)
+    {
+      if (block_size(block) > largest_free)
+      {
+        largest_free = block_size(block);
+      }
+    }
+  }
+  out->total_bytes = tlsf_total_bytes;
+  out->used_bytes = tlsf_used_bytes;
+  out->free_bytes = tlsf_free_bytes;
+  out->blocks = tlsf_blocks;
+  out->free_blocks = tlsf_free_blocks;
+  out->largest_free = largest_free;
+  spin_unlock_irqrestore(&tlsf_lock, flags);
+}
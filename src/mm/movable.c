@@ -0,0 +1,371 @@
+#include "mm/movable.h"
+#include "mm/page.h"
+#include "mm/vmm.h"
+#include "arch/spinlock.h"
+#include "lib/string.h"
+
+#define MOVABLE_ALIGN 8u
+#define MOVABLE_SEGMENT_SIZE ((size_t)PAGE_SIZE)
+
+/*
+ * Every block in the zone starts with one; handle 0 marks a hole. Offsets
+ * run across the segments back to back. A live block never straddles two
+ * segments; the end of a segment too short for the next block is a hole.
+ */
+typedef struct
+{
+  uint32_t handle;
+  uint32_t size;
+} movable_header_t;
+
+typedef struct
+{
+  uint32_t offset;
+  uint32_t size;
+  uint16_t pins;
+  uint16_t generation;
+  uint8_t live;
+} movable_entry_t;
+
+static uint8_t *movable_segments[MOVABLE_MAX_SEGMENTS];
+static size_t movable_segment_count;
+static size_t movable_top;
+static size_t movable_used;
+static size_t movable_holes;
+static movable_entry_t movable_entries[MOVABLE_HANDLES];
+static uint16_t movable_free_slots[MOVABLE_HANDLES];
+static size_t movable_free_count;
+static size_t movable_live;
+static uint32_t movable_moves;
+static uint32_t movable_passes;
+/* Compaction pass state: blocks below dst are packed, scan is the next to visit. */
+static int movable_in_pass;
+static size_t movable_scan;
+static size_t movable_dst;
+/* Set when the last pass could not close a hole because of pinned blocks. */
+static int movable_stalled;
+static spinlock_t movable_lock = SPINLOCK_INIT;
+
+static uint8_t *zone_at(size_t offset)
+{
+  return movable_segments[offset / MOVABLE_SEGMENT_SIZE] + offset % MOVABLE_SEGMENT_SIZE;
+}
+
+static movable_header_t *header_at(size_t offset)
+{
+  return (movable_header_t *)zone_at(offset);
+}
+
+static void *payload_of(const movable_entry_t *entry)
+{
+  return zone_at(entry->offset) + sizeof(movable_header_t);
+}
+
+static void hole_at(size_t offset, size_t size)
+{
+  movable_header_t *hole = header_at(offset);
+  hole->handle = 0;
+  hole->size = (uint32_t)size;
+}
+
+/* Bytes left in offset's segment, or 0 right on a boundary. */
+static size_t segment_rest(size_t offset)
+{
+  size_t within = offset % MOVABLE_SEGMENT_SIZE;
+  return within ? MOVABLE_SEGMENT_SIZE - within : 0;
+}
+
+static movable_entry_t *entry_of(movable_t handle)
+{
+  uint32_t index = (handle & 0xFFFFu) - 1u;
+  if (handle == MOVABLE_NONE || index >= MOVABLE_HANDLES)
+  {
+    return 0;
+  }
+  movable_entry_t *entry = &movable_entries[index];
+  if (!entry->live || entry->generation != (uint16_t)(handle >> 16))
+  {
+    return 0;
+  }
+  return entry;
+}
+
+/* Gives every page past the top back to the page allocator. */
+static void segments_trim(void)
+{
+  size_t keep = (movable_top + MOVABLE_SEGMENT_SIZE - 1) / MOVABLE_SEGMENT_SIZE;
+  while (movable_segment_count > keep)
+  {
+    uint8_t *segment = movable_segments[--movable_segment_count];
+    page_free(virt_to_phys(segment), 0);
+  }
+}
+
+int movable_init(void)
+{
+  movable_segment_count = 0;
+  movable_top = 0;
+  movable_used = 0;
+  movable_holes = 0;
+  movable_live = 0;
+  movable_free_count = MOVABLE_HANDLES;
+  for (size_t i = 0; i < MOVABLE_HANDLES; ++i)
+  {
+    movable_entries[i].live = 0;
+    movable_entries[i].pins = 0;
+    movable_entries[i].generation = 0;
+    movable_free_slots[i] = (uint16_t)(MOVABLE_HANDLES - 1 - i);
+  }
+  return 0;
+}
+
+/*
+ * Slides live blocks down over the holes, at most budget bytes at a time.
+ * A pinned block stays put; the gap in front of it becomes a single hole.
+ * Ends of a pass drop the pages the zone no longer reaches into.
+ */
+static void compact_locked(size_t budget)
+{
+  if (!movable_in_pass)
+  {
+    movable_in_pass = 1;
+    movable_scan = 0;
+    movable_dst = 0;
+  }
+
+  size_t moved = 0;
+  while (moved < budget && movable_scan < movable_top)
+  {
+    movable_header_t *header = header_at(movable_scan);
+    uint32_t size = header->size;
+    if (header->handle == 0)
+    {
+      movable_scan += size;
+      continue;
+    }
+
+    movable_entry_t *entry = &movable_entries[header->handle - 1];
+    if (entry->pins)
+    {
+      if (movable_dst < movable_scan)
+      {
+        hole_at(movable_dst, movable_scan - movable_dst);
+      }
+      movable_scan += size;
+      movable_dst = movable_scan;
+      continue;
+    }
+
+    /* dst only trails into an earlier segment, never into scan's own. */
+    size_t rest = segment_rest(movable_dst);
+    if (rest && rest < size)
+    {
+      hole_at(movable_dst, rest);
+      movable_dst += rest;
+    }
+    if (movable_dst != movable_scan)
+    {
+      memmove(zone_at(movable_dst), header, size);
+      entry->offset = (uint32_t)movable_dst;
+      movable_moves++;
+      moved += size;
+    }
+    movable_scan += size;
+    movable_dst += size;
+  }
+
+  if (movable_scan >= movable_top)
+  {
+    size_t before = movable_holes;
+    movable_top = movable_dst;
+    movable_holes = movable_dst - movable_used;
+    movable_in_pass = 0;
+    movable_passes++;
+    movable_stalled = movable_holes != 0 && movable_holes >= before;
+    segments_trim();
+  }
+}
+
+/* Call with movable_lock held. */
+static movable_entry_t *alloc_locked(size_t size)
+{
+  size_t need = ((size + MOVABLE_ALIGN - 1) & ~(size_t)(MOVABLE_ALIGN - 1)) + sizeof(movable_header_t);
+  if (size == 0 || need > MOVABLE_SEGMENT_SIZE || movable_free_count == 0)
+  {
+    return 0;
+  }
+
+  size_t rest = segment_rest(movable_top);
+  if (rest && rest < need)
+  {
+    hole_at(movable_top, rest);
+    movable_top += rest;
+    movable_holes += rest;
+    movable_stalled = 0;
+  }
+  if (movable_top == movable_segment_count * MOVABLE_SEGMENT_SIZE)
+  {
+    phys_addr_t frame = movable_segment_count < MOVABLE_MAX_SEGMENTS ? page_alloc(0) : 0;
+    if (!frame)
+    {
+      return 0;
+    }
+    movable_segments[movable_segment_count++] = (uint8_t *)phys_to_virt(frame);
+  }
+
+  uint16_t index = movable_free_slots[--movable_free_count];
+  movable_entry_t *entry = &movable_entries[index];
+  movable_header_t *header = header_at(movable_top);
+  header->handle = index + 1u;
+  header->size = (uint32_t)need;
+  entry->offset = (uint32_t)movable_top;
+  entry->size = (uint32_t)size;
+  entry->pins = 0;
+  entry->live = 1;
+  entry->generation++;
+  movable_top += need;
+  movable_used += need;
+  movable_live++;
+  return entry;
+}
+
+static movable_t handle_of(const movable_entry_t *entry)
+{
+  return ((uint32_t)entry->generation << 16) | (uint32_t)(entry - movable_entries + 1);
+}
+
+movable_t movable_alloc(size_t size)
+{
+  uint32_t flags = spin_lock_irqsave(&movable_lock);
+  movable_entry_t *entry = alloc_locked(size);
+  movable_t handle = entry ? handle_of(entry) : MOVABLE_NONE;
+  spin_unlock_irqrestore(&movable_lock, flags);
+  return handle;
+}
+
+movable_t movable_store(const void *data, size_t size)
+{
+  uint32_t flags = spin_lock_irqsave(&movable_lock);
+  movable_entry_t *entry = alloc_locked(size);
+  movable_t handle = MOVABLE_NONE;
+  if (entry)
+  {
+    memcpy(payload_of(entry), data, size);
+    handle = handle_of(entry);
+  }
+  spin_unlock_irqrestore(&movable_lock, flags);
+  return handle;
+}
+
+void movable_free(movable_t handle)
+{
+  uint32_t flags = spin_lock_irqsave(&movable_lock);
+  movable_entry_t *entry = entry_of(handle);
+  if (!entry)
+  {
+    spin_unlock_irqrestore(&movable_lock, flags);
+    return;
+  }
+
+  size_t offset = entry->offset;
+  movable_header_t *header = header_at(offset);
+  header->handle = 0;
+  movable_used -= header->size;
+  /* The newest block just shrinks the zone; anything else leaves a hole. */
+  if (offset + header->size == movable_top && (!movable_in_pass || offset >= movable_scan))
+  {
+    movable_top = offset;
+    if (!movable_in_pass)
+    {
+      segments_trim();
+    }
+  }
+  else
+  {
+    movable_holes += header->size;
+    movable_stalled = 0;
+  }
+  entry->live = 0;
+  movable_free_slots[movable_free_count++] = (uint16_t)(entry - movable_entries);
+  movable_live--;
+  spin_unlock_irqrestore(&movable_lock, flags);
+}
+
+void *movable_pin(movable_t handle)
+{
+  uint32_t flags = spin_lock_irqsave(&movable_lock);
+  movable_entry_t *entry = entry_of(handle);
+  void *ptr = 0;
+  if (entry)
+  {
+    entry->pins++;
+    ptr = payload_of(entry);
+  }
+  spin_unlock_irqrestore(&movable_lock, flags);
+  return ptr;
+}
+
+void movable_unpin(movable_t handle)
+{
+  uint32_t flags = spin_lock_irqsave(&movable_lock);
+  movable_entry_t *entry = entry_of(handle);
+  if (entry && entry->pins > 0)
+  {
+    entry->pins--;
+    movable_stalled = 0;
+  }
+  spin_unlock_irqrestore(&movable_lock, flags);
+}
+
+size_t movable_size(movable_t handle)
+{
+  uint32_t flags = spin_lock_irqsave(&movable_lock);
+  movable_entry_t *entry = entry_of(handle);
+  size_t size = entry ? entry->size : 0;
+  spin_unlock_irqrestore(&movable_lock, flags);
+  return size;
+}
+
+size_t movable_read(movable_t handle, void *out, size_t max)
+{
+  uint32_t flags = spin_lock_irqsave(&movable_lock);
+  movable_entry_t *entry = entry_of(handle);
+  size_t size = 0;
+  if (entry)
+  {
+    size = entry->size < max ? entry->size : max;
+    memcpy(out, payload_of(entry), size);
+  }
+  spin_unlock_irqrestore(&movable_lock, flags);
+  return size;
+}
+
+int movable_compact_step(size_t budget)
+{
+  uint32_t flags = spin_lock_irqsave(&movable_lock);
+  if (movable_in_pass || (movable_holes && !movable_stalled))
+  {
+    compact_locked(budget);
+  }
+  int more = movable_in_pass || (movable_holes && !movable_stalled);
+  spin_unlock_irqrestore(&movable_lock, flags);
+  return more;
+}
+
+void movable_get_stats(movable_stats_t *out)
+{
+  if (!out)
+  {
+    return;
+  }
+
+  uint32_t flags = spin_lock_irqsave(&movable_lock);
+  out->zone_bytes = movable_segment_count * MOVABLE_SEGMENT_SIZE;
+  out->used_bytes = movable_used;
+  out->hole_bytes = movable_holes;
+  out->tail_free = out->zone_bytes - movable_top;
+  out->handles = movable_live;
+  out->moves = movable_moves;
+  out->passes = movable_passes;
+  spin_unlock_irqrestore(&movable_lock, flags);
+}
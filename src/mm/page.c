@@ -0,0 +1,309 @@
+#include "mm/page.h"
+#include "mm/vmm.h"
+#include "arch/spinlock.h"
+
+/* Everything below 1 MiB belongs to the kernel image, boot stacks and BIOS. */
+#define PAGE_LOW_LIMIT 0x100000ull
+/* Frames must be reachable through the kernel's direct map. */
+#define PAGE_PHYS_LIMIT ((uint64_t)VMM_DIRECT_MAP_SIZE)
+
+#define PAGE_FLAG_FREE 0x01u
+
+/* One record per frame; only the first frame of a free block is linked. */
+typedef struct page
+{
+  struct page *next;
+  struct page *prev;
+  uint8_t order;
+  uint8_t flags;
+} page_t;
+
+static page_t *page_frames;
+static size_t page_frame_count;
+static page_t *page_free_lists[PAGE_MAX_ORDER + 1];
+static size_t page_free_blocks[PAGE_MAX_ORDER + 1];
+static size_t page_total;
+static size_t page_free_total;
+static uint64_t page_meta_start;
+static uint64_t page_meta_end;
+static spinlock_t page_lock = SPINLOCK_INIT;
+
+static size_t page_pfn(const page_t *page)
+{
+  return (size_t)(page - page_frames);
+}
+
+static void free_list_push(page_t *page, unsigned order)
+{
+  page->order = (uint8_t)order;
+  page->flags |= PAGE_FLAG_FREE;
+  page->prev = 0;
+  page->next = page_free_lists[order];
+  if (page->next)
+  {
+    page->next->prev = page;
+  }
+  page_free_lists[order] = page;
+  page_free_blocks[order]++;
+}
+
+static void free_list_remove(page_t *page, unsigned order)
+{
+  if (page->prev)
+  {
+    page->prev->next = page->next;
+  }
+  else
+  {
+    page_free_lists[order] = page->next;
+  }
+  if (page->next)
+  {
+    page->next->prev = page->prev;
+  }
+  page->next = 0;
+  page->prev = 0;
+  page->flags &= (uint8_t)~PAGE_FLAG_FREE;
+  page_free_blocks[order]--;
+}
+
+/* Frees a block and merges it with its buddy for as long as the buddy is free. */
+static void free_block(size_t pfn, unsigned order)
+{
+  while (order < PAGE_MAX_ORDER)
+  {
+    size_t buddy_pfn = pfn ^ ((size_t)1 << order);
+    if (buddy_pfn >= page_frame_count)
+    {
+      break;
+    }
+    page_t *buddy = &page_frames[buddy_pfn];
+    if (!(buddy->flags & PAGE_FLAG_FREE) || buddy->order != order)
+    {
+      break;
+    }
+    free_list_remove(buddy, order);
+    pfn &= ~((size_t)1 << order);
+    order++;
+  }
+  free_list_push(&page_frames[pfn], order);
+}
+
+static int range_overlaps(uint64_t start, uint64_t end, uint64_t base, uint64_t limit)
+{
+  return start < limit && base < end;
+}
+
+/* A frame is only handed out if no non-usable E820 entry touches it. */
+static int frame_usable(const e820_map_t *map, uint64_t addr)
+{
+  if (range_overlaps(addr, addr + PAGE_SIZE, page_meta_start, page_meta_end))
+  {
+    return 0;
+  }
+  for (uint32_t i = 0; i < map->count; ++i)
+  {
+    const e820_entry_t *entry = &map->entries[i];
+    if (entry->type != E820_USABLE &&
+        range_overlaps(addr, addr + PAGE_SIZE, entry->base, entry->base + entry->length))
+    {
+      return 0;
+    }
+  }
+  return 1;
+}
+
+static void free_range(size_t start_pfn, size_t end_pfn)
+{
+  size_t pfn = start_pfn;
+  while (pfn < end_pfn)
+  {
+    unsigned order = PAGE_MAX_ORDER;
+    while (order > 0 &&
+           ((pfn & (((size_t)1 << order) - 1)) != 0 || pfn + ((size_t)1 << order) > end_pfn))
+    {
+      order--;
+    }
+    free_block(pfn, order);
+    pfn += (size_t)1 << order;
+  }
+  page_total += end_pfn - start_pfn;
+  page_free_total += end_pfn - start_pfn;
+}
+
+static void entry_clip(const e820_entry_t *entry, uint64_t *start, uint64_t *end)
+{
+  *start = (entry->base + PAGE_SIZE - 1) & ~(uint64_t)(PAGE_SIZE - 1);
+  *end = (entry->base + entry->length) & ~(uint64_t)(PAGE_SIZE - 1);
+  if (*start < PAGE_LOW_LIMIT)
+  {
+    *start = PAGE_LOW_LIMIT;
+  }
+  if (*end > PAGE_PHYS_LIMIT)
+  {
+    *end = PAGE_PHYS_LIMIT;
+  }
+}
+
+int page_init(const e820_map_t *map)
+{
+  if (!map || map->count == 0)
+  {
+    return -1;
+  }
+
+  uint64_t top = 0;
+  for (uint32_t i = 0; i < map->count; ++i)
+  {
+    uint64_t start, end;
+    entry_clip(&map->entries[i], &start, &end);
+    if (map->entries[i].type == E820_USABLE && end > start && end > top)
+    {
+      top = end;
+    }
+  }
+  if (top == 0)
+  {
+    return -1;
+  }
+
+  /* The frame array lives at the start of the first usable range that fits it. */
+  page_frame_count = (size_t)(top >> PAGE_SHIFT);
+  uint64_t meta_size = ((uint64_t)page_frame_count * sizeof(page_t) + PAGE_SIZE - 1) & ~(uint64_t)(PAGE_SIZE - 1);
+  page_meta_start = 0;
+  page_meta_end = 0;
+  for (uint32_t i = 0; i < map->count && page_meta_end == 0; ++i)
+  {
+    uint64_t start, end;
+    entry_clip(&map->entries[i], &start, &end);
+    if (map->entries[i].type == E820_USABLE && end > start && end - start >= meta_size)
+    {
+      page_meta_start = start;
+      page_meta_end = start + meta_size;
+    }
+  }
+  if (page_meta_end == 0)
+  {
+    return -1;
+  }
+
+  page_frames = (page_t *)phys_to_virt((phys_addr_t)page_meta_start);
+  for (size_t i = 0; i < page_frame_count; ++i)
+  {
+    page_frames[i].next = 0;
+    page_frames[i].prev = 0;
+    page_frames[i].order = 0;
+    page_frames[i].flags = 0;
+  }
+  for (unsigned order = 0; order <= PAGE_MAX_ORDER; ++order)
+  {
+    page_free_lists[order] = 0;
+    page_free_blocks[order] = 0;
+  }
+  page_total = 0;
+  page_free_total = 0;
+
+  for (uint32_t i = 0; i < map->count; ++i)
+  {
+    uint64_t start, end;
+    entry_clip(&map->entries[i], &start, &end);
+    if (map->entries[i].type != E820_USABLE || end <= start)
+    {
+      continue;
+    }
+    /* Split the range into runs of frames that no reserved entry overlaps. */
+    size_t run_start = 0;
+    int in_run = 0;
+    for (uint64_t addr = start; addr < end; addr += PAGE_SIZE)
+    {
+      size_t pfn = (size_t)(addr >> PAGE_SHIFT);
+      if (frame_usable(map, addr))
+      {
+        if (!in_run)
+        {
+          run_start = pfn;
+          in_run = 1;
+        }
+      }
+      else if (in_run)
+      {
+        free_range(run_start, pfn);
+        in_run = 0;
+      }
+    }
+    if (in_run)
+    {
+      free_range(run_start, (size_t)(end >> PAGE_SHIFT));
+    }
+  }
+  return page_total ? 0 : -1;
+}
+
+phys_addr_t page_alloc(unsigned order)
+{
+  if (order > PAGE_MAX_ORDER)
+  {
+    return 0;
+  }
+
+  uint32_t flags = spin_lock_irqsave(&page_lock);
+  unsigned found = order;
+  while (found <= PAGE_MAX_ORDER && !page_free_lists[found])
+  {
+    found++;
+  }
+  if (found > PAGE_MAX_ORDER)
+  {
+    spin_unlock_irqrestore(&page_lock, flags);
+    return 0;
+  }
+
+  page_t *page = page_free_lists[found];
+  free_list_remove(page, found);
+  size_t pfn = page_pfn(page);
+  /* Split down to the requested size, returning upper halves to the lists. */
+  while (found > order)
+  {
+    found--;
+    free_list_push(&page_frames[pfn + ((size_t)1 << found)], found);
+  }
+  page->order = (uint8_t)order;
+  page_free_total -= (size_t)1 << order;
+  spin_unlock_irqrestore(&page_lock, flags);
+  return (phys_addr_t)(pfn << PAGE_SHIFT);
+}
+
+void page_free(phys_addr_t addr, unsigned order)
+{
+  if (!addr || order > PAGE_MAX_ORDER)
+  {
+    return;
+  }
+  size_t pfn = (size_t)(addr >> PAGE_SHIFT);
+  if (pfn >= page_frame_count)
+  {
+    return;
+  }
+
+  uint32_t flags = spin_lock_irqsave(&page_lock);
+  free_block(pfn, order);
+  page_free_total += (size_t)1 << order;
+  spin_unlock_irqrestore(&page_lock, flags);
+}
+
+void page_get_stats(page_stats_t *out)
+{
+  if (!out)
+  {
+    return;
+  }
+
+  uint32_t flags = spin_lock_irqsave(&page_lock);
+  out->total_pages = page_total;
+  out->free_pages = page_free_total;
+  for (unsigned order = 0; order <= PAGE_MAX_ORDER; ++order)
+  {
+    out->free_blocks[order] = page_free_blocks[order];
+  }
+  spin_unlock_irqrestore(&page_lock, flags);
+}
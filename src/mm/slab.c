@@ -0,0 +1,255 @@
+#include "mm/slab.h"
+#include "mm/page.h"
+#include "mm/vmm.h"
+#include "arch/spinlock.h"
+
+#define SLAB_MAGIC 0x51AB51ABu
+#define SLAB_MIN_SHIFT 4
+#define SLAB_BITMAP_WORDS (PAGE_SIZE / SLAB_MIN_SIZE / 32u)
+
+/*
+ * Slab header at the start of its page. Bit n of the bitmap is set while
+ * object n is free, so finding one is a scan of at most eight words.
+ */
+typedef struct slab
+{
+  uint32_t magic;
+  struct slab *next;
+  struct slab *prev;
+  uint16_t cache;
+  uint16_t free;
+  uint16_t capacity;
+  uint16_t offset;
+  uint32_t bitmap[SLAB_BITMAP_WORDS];
+} slab_t;
+
+typedef struct
+{
+  uint32_t size;
+  uint32_t shift;
+  /* Slabs with at least one free object; full slabs are on no list. */
+  slab_t *partial;
+  /* One completely free slab is kept to absorb alloc/free churn. */
+  slab_t *spare;
+  size_t slabs;
+  size_t objects_used;
+  size_t objects_total;
+  spinlock_t lock;
+} slab_cache_t;
+
+static slab_cache_t slab_caches[SLAB_CLASS_COUNT];
+
+static void partial_push(slab_cache_t *cache, slab_t *slab)
+{
+  slab->prev = 0;
+  slab->next = cache->partial;
+  if (slab->next)
+  {
+    slab->next->prev = slab;
+  }
+  cache->partial = slab;
+}
+
+static void partial_remove(slab_cache_t *cache, slab_t *slab)
+{
+  if (slab->prev)
+  {
+    slab->prev->next = slab->next;
+  }
+  else
+  {
+    cache->partial = slab->next;
+  }
+  if (slab->next)
+  {
+    slab->next->prev = slab->prev;
+  }
+  slab->next = 0;
+  slab->prev = 0;
+}
+
+static slab_t *slab_create(size_t index)
+{
+  slab_cache_t *cache = &slab_caches[index];
+  phys_addr_t frame = page_alloc(0);
+  if (!frame)
+  {
+    return 0;
+  }
+
+  slab_t *slab = (slab_t *)phys_to_virt(frame);
+  uint32_t offset = ((uint32_t)sizeof(slab_t) + 15u) & ~15u;
+  slab->magic = SLAB_MAGIC;
+  slab->next = 0;
+  slab->prev = 0;
+  slab->cache = (uint16_t)index;
+  slab->offset = (uint16_t)offset;
+  slab->capacity = (uint16_t)((PAGE_SIZE - offset) >> cache->shift);
+  slab->free = slab->capacity;
+  for (uint32_t i = 0; i < SLAB_BITMAP_WORDS; ++i)
+  {
+    uint32_t first = i * 32u;
+    if (first + 32u <= slab->capacity)
+    {
+      slab->bitmap[i] = 0xFFFFFFFFu;
+    }
+    else if (first < slab->capacity)
+    {
+      slab->bitmap[i] = (1u << (slab->capacity - first)) - 1u;
+    }
+    else
+    {
+      slab->bitmap[i] = 0;
+    }
+  }
+  cache->slabs++;
+  cache->objects_total += slab->capacity;
+  return slab;
+}
+
+void slab_init(void)
+{
+  for (size_t i = 0; i < SLAB_CLASS_COUNT; ++i)
+  {
+    slab_cache_t *cache = &slab_caches[i];
+    cache->shift = SLAB_MIN_SHIFT + (uint32_t)i;
+    cache->size = 1u << cache->shift;
+    cache->partial = 0;
+    cache->spare = 0;
+    cache->slabs = 0;
+    cache->objects_used = 0;
+    cache->objects_total = 0;
+    spin_init(&cache->lock);
+  }
+}
+
+void *slab_alloc(size_t size)
+{
+  if (size > SLAB_MAX_SIZE)
+  {
+    return 0;
+  }
+  size_t index = 0;
+  while ((SLAB_MIN_SIZE << index) < size)
+  {
+    index++;
+  }
+
+  slab_cache_t *cache = &slab_caches[index];
+  uint32_t flags = spin_lock_irqsave(&cache->lock);
+  slab_t *slab = cache->partial;
+  if (!slab)
+  {
+    slab = slab_create(index);
+    if (!slab)
+    {
+      spin_unlock_irqrestore(&cache->lock, flags);
+      return 0;
+    }
+    partial_push(cache, slab);
+  }
+  if (slab == cache->spare)
+  {
+    cache->spare = 0;
+  }
+
+  uint32_t word = 0;
+  while (!slab->bitmap[word])
+  {
+    word++;
+  }
+  uint32_t bit = (uint32_t)__builtin_ctz(slab->bitmap[word]);
+  slab->bitmap[word] &= ~(1u << bit);
+  slab->free--;
+  if (slab->free == 0)
+  {
+    partial_remove(cache, slab);
+  }
+  cache->objects_used++;
+  spin_unlock_irqrestore(&cache->lock, flags);
+
+  uint32_t object = word * 32u + bit;
+  return (uint8_t *)slab + slab->offset + (object << cache->shift);
+}
+
+static slab_t *slab_of(const void *ptr)
+{
+  slab_t *slab = (slab_t *)((uintptr_t)ptr & ~((uintptr_t)PAGE_SIZE - 1));
+  if (!ptr || slab->magic != SLAB_MAGIC || slab->cache >= SLAB_CLASS_COUNT)
+  {
+    return 0;
+  }
+  return slab;
+}
+
+size_t slab_object_size(const void *ptr)
+{
+  slab_t *slab = slab_of(ptr);
+  return slab ? slab_caches[slab->cache].size : 0;
+}
+
+size_t slab_free(void *ptr)
+{
+  slab_t *slab = slab_of(ptr);
+  if (!slab)
+  {
+    return 0;
+  }
+
+  slab_cache_t *cache = &slab_caches[slab->cache];
+  uint32_t object = (uint32_t)((uint8_t *)ptr - ((uint8_t *)slab + slab->offset)) >> cache->shift;
+  uint32_t word = object / 32u;
+  uint32_t bit = 1u << (object % 32u);
+
+  uint32_t flags = spin_lock_irqsave(&cache->lock);
+  if (object >= slab->capacity || (slab->bitmap[word] & bit))
+  {
+    spin_unlock_irqrestore(&cache->lock, flags);
+    return 0;
+  }
+  slab->bitmap[word] |= bit;
+  slab->free++;
+  cache->objects_used--;
+  if (slab->free == 1)
+  {
+    partial_push(cache, slab);
+  }
+
+  phys_addr_t release = 0;
+  if (slab->free == slab->capacity)
+  {
+    if (!cache->spare)
+    {
+      cache->spare = slab;
+    }
+    else if (cache->spare != slab)
+    {
+      partial_remove(cache, slab);
+      slab->magic = 0;
+      cache->slabs--;
+      cache->objects_total -= slab->capacity;
+      release = virt_to_phys(slab);
+    }
+  }
+  spin_unlock_irqrestore(&cache->lock, flags);
+
+  page_free(release, 0);
+  return cache->size;
+}
+
+int slab_cache_stats(size_t index, slab_cache_stats_t *out)
+{
+  if (index >= SLAB_CLASS_COUNT || !out)
+  {
+    return -1;
+  }
+
+  slab_cache_t *cache = &slab_caches[index];
+  uint32_t flags = spin_lock_irqsave(&cache->lock);
+  out->object_size = cache->size;
+  out->slabs = cache->slabs;
+  out->objects_used = cache->objects_used;
+  out->objects_total = cache->objects_total;
+  spin_unlock_irqrestore(&cache->lock, flags);
+  return 0;
+}
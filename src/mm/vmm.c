@@ -0,0 +1,150 @@
+#include "mm/vmm.h"
+#include "arch/smp.h"
+#include "arch/spinlock.h"
+
+#define PDE_PRESENT 0x001u
+#define PDE_LARGE 0x080u
+#define PTE_PRESENT 0x001u
+#define PTE_ADDR_MASK 0xFFFFF000u
+#define LARGE_ADDR_MASK 0xFFC00000u
+#define PT_ENTRIES 1024u
+
+static uintptr_t vmm_mmio_next = VMM_DYNAMIC_BASE;
+static spinlock_t vmm_lock = SPINLOCK_INIT;
+
+static void invlpg(uintptr_t virt)
+{
+  __asm__ __volatile__("invlpg (%0)" : : "r"(virt) : "memory");
+}
+
+static uint32_t *page_table_of(uintptr_t virt, int create)
+{
+  uint32_t *pde = &boot_page_directory[virt >> 22];
+  if (*pde & PDE_PRESENT)
+  {
+    if (*pde & PDE_LARGE)
+    {
+      return 0;
+    }
+    return (uint32_t *)phys_to_virt(*pde & PTE_ADDR_MASK);
+  }
+  if (!create)
+  {
+    return 0;
+  }
+
+  phys_addr_t frame = page_alloc(0);
+  if (!frame)
+  {
+    return 0;
+  }
+  uint32_t *table = (uint32_t *)phys_to_virt(frame);
+  for (uint32_t i = 0; i < PT_ENTRIES; ++i)
+  {
+    table[i] = 0;
+  }
+  *pde = frame | VMM_WRITE | PDE_PRESENT;
+  return table;
+}
+
+int vmm_map(uintptr_t virt, phys_addr_t phys, uint32_t flags)
+{
+  uint32_t irq = spin_lock_irqsave(&vmm_lock);
+  uint32_t *table = page_table_of(virt, 1);
+  if (!table)
+  {
+    spin_unlock_irqrestore(&vmm_lock, irq);
+    return -1;
+  }
+  uint32_t *pte = &table[(virt >> 12) & (PT_ENTRIES - 1)];
+  int remap = (*pte & PTE_PRESENT) != 0;
+  *pte = (phys & PTE_ADDR_MASK) | (flags & (VMM_WRITE | VMM_NOCACHE)) | PTE_PRESENT;
+  spin_unlock_irqrestore(&vmm_lock, irq);
+
+  /* A fresh mapping cannot be cached anywhere; replacing one can. */
+  if (remap)
+  {
+    invlpg(virt);
+    smp_tlb_shootdown(virt);
+  }
+  return 0;
+}
+
+int vmm_unmap(uintptr_t virt)
+{
+  uint32_t irq = spin_lock_irqsave(&vmm_lock);
+  uint32_t *table = page_table_of(virt, 0);
+  if (!table)
+  {
+    spin_unlock_irqrestore(&vmm_lock, irq);
+    return -1;
+  }
+  uint32_t *pte = &table[(virt >> 12) & (PT_ENTRIES - 1)];
+  if (!(*pte & PTE_PRESENT))
+  {
+    spin_unlock_irqrestore(&vmm_lock, irq);
+    return -1;
+  }
+  *pte = 0;
+  invlpg(virt);
+  spin_unlock_irqrestore(&vmm_lock, irq);
+
+  smp_tlb_shootdown(virt);
+  return 0;
+}
+
+phys_addr_t vmm_translate(uintptr_t virt)
+{
+  uint32_t pde = boot_page_directory[virt >> 22];
+  if (!(pde & PDE_PRESENT))
+  {
+    return 0;
+  }
+  if (pde & PDE_LARGE)
+  {
+    return (pde & LARGE_ADDR_MASK) | (virt & ~LARGE_ADDR_MASK);
+  }
+  uint32_t pte = ((uint32_t *)phys_to_virt(pde & PTE_ADDR_MASK))[(virt >> 12) & (PT_ENTRIES - 1)];
+  if (!(pte & PTE_PRESENT))
+  {
+    return 0;
+  }
+  return (pte & PTE_ADDR_MASK) | (virt & ~PTE_ADDR_MASK);
+}
+
+void *vmm_map_mmio(phys_addr_t phys, size_t size)
+{
+  phys_addr_t offset = phys & ~PTE_ADDR_MASK;
+  size_t pages = (offset + size + PAGE_SIZE - 1) / PAGE_SIZE;
+
+  uint32_t irq = spin_lock_irqsave(&vmm_lock);
+  uintptr_t virt = vmm_mmio_next;
+  if (pages == 0 || pages > (VMM_STACK_BASE - virt) / PAGE_SIZE)
+  {
+    spin_unlock_irqrestore(&vmm_lock, irq);
+    return 0;
+  }
+  vmm_mmio_next += pages * PAGE_SIZE;
+  spin_unlock_irqrestore(&vmm_lock, irq);
+
+  for (size_t i = 0; i < pages; ++i)
+  {
+    if (vmm_map(virt + i * PAGE_SIZE, (phys - offset) + i * PAGE_SIZE, VMM_WRITE | VMM_NOCACHE) != 0)
+    {
+      return 0;
+    }
+  }
+  return (void *)(virt + offset);
+}
+
+void vmm_drop_identity(void)
+{
+  uint32_t irq = spin_lock_irqsave(&vmm_lock);
+  boot_page_directory[0] = 0;
+  /* PSE entries are not global, so a CR3 reload drops them everywhere. */
+  uint32_t cr3;
+  __asm__ __volatile__("mov %%cr3, %0\n\tmov %0, %%cr3" : "=r"(cr3) : : "memory");
+  spin_unlock_irqrestore(&vmm_lock, irq);
+
+  smp_tlb_shootdown(SMP_TLB_FLUSH_ALL);
+}
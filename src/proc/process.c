@@ -1,10 +1,30 @@
 #include "proc/process.h"
+#include "proc/wait.h"
+#include "arch/cpu.h"
+#include "arch/smp.h"
+#include "arch/spinlock.h"
 #include "mm/heap.h"
+#include "mm/arena.h"
+#include "mm/movable.h"
+#include "proc/stack.h"
 #include "sys/watchdog.h"
+#include "sys/timer.h"
+#include "sys/clock.h"
+#include "sys/panic.h"
+#include "lib/string.h"
 
-#define MAX_PROCESSES 8
+#define PROCESS_TABLE_INITIAL 8
+#define PROCESS_PID_BUCKETS 64
+#define PROCESS_NAME_BUCKETS 32
+#define PROCESS_PID_MAX 32767u
+#define KERNEL_PID 1
+#define PROCESS_RECORD_CACHE_MAX 4
+#define FPU_STATE_SIZE 512
+#define FPU_STATE_ALIGN 16
+#define FPU_CPU_NONE 0xFF
+#define PROCESS_IDLE_COMPACT_BYTES 1024
 
-typedef struct
+typedef struct process
 {
   const char *name;
   void (*entry)(void *);
@@ -13,149 +33,652 @@ typedef struct
   uint8_t *stack_base;
   size_t stack_size;
   uint32_t pid;
-  int used;
+  size_t slot;
   int kill_requested;
   int reap;
   int active;
+  process_state_t state;
+  ktimer_t sleep_timer;
+  /* Set while sleep_timer belongs to the current sleep; see process_timeout. */
+  int timeout_armed;
+  wait_queue_t *wait_on;
+  struct process *wait_next;
+  struct process *wait_prev;
+  uint8_t priority;
+  uint8_t queued;
+  uint8_t cpu;
+  uint32_t lock_depth;
+  struct process *runq_next;
+  struct process *runq_prev;
+  struct process *zombie_next;
+  struct process *pid_next;
+  struct process *name_next;
+  uint64_t run_start;
+  uint64_t run_cycles;
+  uint64_t queued_at;
+  uint64_t wait_cycles;
+  uint64_t switches;
+  uint64_t voluntary_switches;
+  uint64_t involuntary_switches;
+  /* FXSAVE area, allocated on the first FPU/SSE instruction. */
+  uint8_t *fpu_state;
+  /* CPU whose registers last held this state; live while TS is clear for it. */
+  uint8_t fpu_cpu;
+  uint8_t fpu_live;
+  arena_t arena;
 } process_t;
 
+typedef struct
+{
+  process_t *head;
+  process_t *tail;
+} run_queue_t;
+
+/*
+ * Scheduler state owned by one CPU. Processes are queued on the CPU they
+ * last ran on; a CPU that runs dry steals from the busiest other one.
+ */
+typedef struct
+{
+  process_t *current;
+  process_t idle;
+  int online;
+  /* One FIFO per priority; bit n of the bitmap is set while queue n is non-empty. */
+  run_queue_t run_queues[PROCESS_PRIORITIES];
+  uint32_t run_queue_bitmap;
+  uint32_t nr_queued;
+  volatile uint32_t slice_left;
+  volatile int need_resched;
+  /* Whose FPU state the registers hold; it is also saved in memory. */
+  process_t *fpu_loaded;
+} sched_cpu_t;
+
 extern void switch_context(uint32_t **old_sp, uint32_t *new_sp);
 
-static process_t processes[MAX_PROCESSES];
+/*
+ * The table only maps slot indices (used by the ps-style accessors) to
+ * heap-allocated process records, so it can grow without moving the
+ * records that wait queues, run queues and timers point into.
+ */
+static process_t kernel_process;
+static process_t **process_table;
+static size_t process_capacity;
 static size_t process_total;
-static size_t current_process;
+static size_t *process_free_slots;
+static size_t process_free_count;
+static process_t *process_pid_hash[PROCESS_PID_BUCKETS];
+static process_t *process_name_hash[PROCESS_NAME_BUCKETS];
+static uint32_t process_next_pid;
 static volatile uint64_t process_ticks;
+static uint32_t process_timeslice = PROCESS_DEFAULT_TIMESLICE;
+static volatile uint64_t process_timer_ticks;
+static volatile uint64_t process_idle_ticks;
+static sched_cpu_t sched_cpus[SMP_MAX_CPUS];
+static process_t *zombie_list;
+static process_t *process_free_records;
+static int fpu_lazy;
+static size_t process_free_record_count;
+
+/*
+ * One lock covers the process table, every run queue and every wait queue.
+ * It nests on the owning CPU, because scheduler paths call back into code
+ * that takes it again (exit hooks restart services, wake_up from log_write).
+ * A process switching out keeps it held; the process switched to inherits it
+ * and restores its own nesting depth, so a context switch is atomic.
+ */
+static spinlock_t sched_spin = SPINLOCK_INIT;
+static volatile int32_t sched_owner = -1;
+static uint32_t sched_depth;
+
+uint32_t sched_lock(void)
+{
+  uint32_t flags = cpu_irq_save();
+  int32_t cpu = (int32_t)smp_cpu_id();
+  if (sched_owner == cpu)
+  {
+    sched_depth++;
+    return flags;
+  }
+  spin_lock(&sched_spin);
+  sched_owner = cpu;
+  sched_depth = 1;
+  return flags;
+}
+
+void sched_unlock(uint32_t flags)
+{
+  if (--sched_depth == 0)
+  {
+    sched_owner = -1;
+    spin_unlock(&sched_spin);
+  }
+  cpu_irq_restore(flags);
+}
+
+static sched_cpu_t *this_cpu(void)
+{
+  return &sched_cpus[smp_cpu_id()];
+}
+
+/* A process can migrate, so only stable with the scheduler lock held. */
+static int process_running(const process_t *process)
+{
+  return sched_cpus[process->cpu].current == process;
+}
 
 __attribute__((weak)) void process_on_exit(const char *name)
 {
   (void)name;
 }
 
-static int pid_in_use(uint32_t pid)
+static uint32_t name_hash(const char *name)
 {
-  if (pid == 0)
+  uint32_t hash = 2166136261u;
+  while (*name)
   {
-    return 1;
+    hash ^= (uint8_t)*name++;
+    hash *= 16777619u;
   }
-  for (size_t i = 0; i < process_total; ++i)
+  return hash;
+}
+
+static int name_eq(const char *a, const char *b)
+{
+  while (*a && *b)
   {
-    if (processes[i].used && processes[i].pid == pid)
+    if (*a != *b)
     {
-      return 1;
+      return 0;
     }
+    a++;
+    b++;
   }
-  return 0;
+  return *a == '\0' && *b == '\0';
 }
 
-static uint32_t alloc_pid(void)
+static process_t *pid_lookup(uint32_t pid)
 {
-  uint32_t pid = 1;
-  while (pid_in_use(pid))
+  process_t *process = process_pid_hash[pid & (PROCESS_PID_BUCKETS - 1)];
+  while (process && process->pid != pid)
   {
-    pid++;
+    process = process->pid_next;
   }
-  return pid;
+  return process;
 }
 
-static size_t find_free_slot(void)
+static void index_insert(process_t *process)
 {
-  for (size_t i = 1; i < process_total; ++i)
+  process_t **pid_bucket = &process_pid_hash[process->pid & (PROCESS_PID_BUCKETS - 1)];
+  process->pid_next = *pid_bucket;
+  *pid_bucket = process;
+
+  if (process->name)
+  {
+    process_t **name_bucket = &process_name_hash[name_hash(process->name) & (PROCESS_NAME_BUCKETS - 1)];
+    process->name_next = *name_bucket;
+    *name_bucket = process;
+  }
+}
+
+static void index_remove(process_t *process)
+{
+  process_t **link = &process_pid_hash[process->pid & (PROCESS_PID_BUCKETS - 1)];
+  while (*link && *link != process)
+  {
+    link = &(*link)->pid_next;
+  }
+  if (*link)
   {
-    if (!processes[i].used)
+    *link = process->pid_next;
+  }
+
+  if (process->name)
+  {
+    link = &process_name_hash[name_hash(process->name) & (PROCESS_NAME_BUCKETS - 1)];
+    while (*link && *link != process)
     {
-      return i;
+      link = &(*link)->name_next;
+    }
+    if (*link)
+    {
+      *link = process->name_next;
     }
   }
-  return process_total;
+  process->pid_next = 0;
+  process->name_next = 0;
+}
+
+/* Pids advance monotonically and wrap, skipping any still in use. */
+static uint32_t alloc_pid(void)
+{
+  for (;;)
+  {
+    uint32_t pid = process_next_pid++;
+    if (process_next_pid > PROCESS_PID_MAX)
+    {
+      process_next_pid = KERNEL_PID + 1;
+    }
+    if (!pid_lookup(pid))
+    {
+      return pid;
+    }
+  }
+}
+
+static int table_grow(void)
+{
+  size_t capacity = process_capacity ? process_capacity * 2 : PROCESS_TABLE_INITIAL;
+  /* A failed second resize leaves the first one bigger than needed, which is harmless. */
+  process_t **table = (process_t **)krealloc(process_table, capacity * sizeof(process_t *));
+  if (!table)
+  {
+    return -1;
+  }
+  process_table = table;
+  size_t *free_slots = (size_t *)krealloc(process_free_slots, capacity * sizeof(size_t));
+  if (!free_slots)
+  {
+    return -1;
+  }
+  process_free_slots = free_slots;
+
+  for (size_t i = process_capacity; i < capacity; ++i)
+  {
+    table[i] = 0;
+  }
+  process_capacity = capacity;
+  return 0;
 }
 
-static void process_cleanup(size_t index)
+static int alloc_slot(size_t *slot_out)
 {
-  if (processes[index].stack_base)
+  if (process_free_count > 0)
   {
-    kfree(processes[index].stack_base);
+    *slot_out = process_free_slots[--process_free_count];
+    return 0;
   }
-  processes[index].stack_base = 0;
-  processes[index].stack_size = 0;
-  processes[index].used = 0;
-  processes[index].active = 0;
-  processes[index].kill_requested = 0;
-  processes[index].reap = 0;
-  processes[index].pid = 0;
-  processes[index].name = 0;
-  processes[index].entry = 0;
-  processes[index].arg = 0;
-  processes[index].sp = 0;
+  if (process_total == process_capacity && table_grow() != 0)
+  {
+    return -1;
+  }
+  *slot_out = process_total++;
+  return 0;
 }
 
-static void reap_zombies(void)
+static process_t *process_at(size_t index)
+{
+  if (index >= process_total)
+  {
+    return 0;
+  }
+  return process_table[index];
+}
+
+static void wait_unlink(process_t *process)
+{
+  wait_queue_t *wq = process->wait_on;
+  if (!wq)
+  {
+    return;
+  }
+  if (process->wait_prev)
+  {
+    process->wait_prev->wait_next = process->wait_next;
+  }
+  else
+  {
+    wq->head = process->wait_next;
+  }
+  if (process->wait_next)
+  {
+    process->wait_next->wait_prev = process->wait_prev;
+  }
+  else
+  {
+    wq->tail = process->wait_prev;
+  }
+  process->wait_on = 0;
+  process->wait_next = 0;
+  process->wait_prev = 0;
+}
+
+static void runq_push(process_t *process)
+{
+  if (process->queued)
+  {
+    return;
+  }
+  sched_cpu_t *cpu = &sched_cpus[process->cpu];
+  run_queue_t *rq = &cpu->run_queues[process->priority];
+  process->runq_next = 0;
+  process->runq_prev = rq->tail;
+  if (rq->tail)
+  {
+    rq->tail->runq_next = process;
+  }
+  else
+  {
+    rq->head = process;
+  }
+  rq->tail = process;
+  process->queued = 1;
+  process->queued_at = clock_cycles();
+  cpu->run_queue_bitmap |= 1u << process->priority;
+  cpu->nr_queued++;
+}
+
+static void runq_remove(process_t *process)
+{
+  if (!process->queued)
+  {
+    return;
+  }
+  sched_cpu_t *cpu = &sched_cpus[process->cpu];
+  run_queue_t *rq = &cpu->run_queues[process->priority];
+  if (process->runq_prev)
+  {
+    process->runq_prev->runq_next = process->runq_next;
+  }
+  else
+  {
+    rq->head = process->runq_next;
+  }
+  if (process->runq_next)
+  {
+    process->runq_next->runq_prev = process->runq_prev;
+  }
+  else
+  {
+    rq->tail = process->runq_prev;
+  }
+  process->runq_next = 0;
+  process->runq_prev = 0;
+  process->queued = 0;
+  process->wait_cycles += clock_cycles() - process->queued_at;
+  cpu->nr_queued--;
+  if (!rq->head)
+  {
+    cpu->run_queue_bitmap &= ~(1u << process->priority);
+  }
+}
+
+static process_t *runq_take(sched_cpu_t *cpu)
 {
-  for (size_t i = 1; i < process_total; ++i)
+  uint32_t prio = (uint32_t)__builtin_ctz(cpu->run_queue_bitmap);
+  process_t *process = cpu->run_queues[prio].head;
+  runq_remove(process);
+  return process;
+}
+
+static sched_cpu_t *runq_busiest(uint32_t self)
+{
+  sched_cpu_t *busiest = 0;
+  for (uint32_t i = 0; i < SMP_MAX_CPUS; ++i)
   {
-    if (i == current_process)
+    sched_cpu_t *cpu = &sched_cpus[i];
+    if (i != self && cpu->online && cpu->nr_queued > 0 &&
+        (!busiest || cpu->nr_queued > busiest->nr_queued))
     {
-      continue;
+      busiest = cpu;
     }
-    if (processes[i].reap)
+  }
+  return busiest;
+}
+
+/*
+ * Highest-priority process queued on this CPU; failing that, the best one
+ * stolen from the CPU with the longest queue. 0 if nothing is runnable.
+ */
+static process_t *runq_pop(uint32_t self)
+{
+  sched_cpu_t *cpu = &sched_cpus[self];
+  if (cpu->run_queue_bitmap)
+  {
+    return runq_take(cpu);
+  }
+
+  sched_cpu_t *victim = runq_busiest(self);
+  if (!victim)
+  {
+    return 0;
+  }
+  process_t *process = runq_take(victim);
+  process->cpu = (uint8_t)self;
+  return process;
+}
+
+static int runq_has_work(uint32_t self)
+{
+  return sched_cpus[self].run_queue_bitmap != 0 || runq_busiest(self) != 0;
+}
+
+/* Nudges a CPU to pick up a process that was just queued. */
+static void process_kick(process_t *process)
+{
+  uint32_t self = smp_cpu_id();
+  uint32_t target = process->cpu;
+  sched_cpu_t *cpu = &sched_cpus[target];
+
+  if (cpu->current != &cpu->idle && process->priority >= cpu->current->priority)
+  {
+    /* Its own CPU is busy with equal or better work: let an idle one steal it. */
+    for (uint32_t i = 0; i < SMP_MAX_CPUS; ++i)
     {
-      const char *name = processes[i].name;
-      process_cleanup(i);
-      process_on_exit(name);
+      sched_cpu_t *other = &sched_cpus[i];
+      if (other->online && other->current == &other->idle)
+      {
+        if (i != self)
+        {
+          smp_send_reschedule(i);
+        }
+        return;
+      }
     }
+    return;
+  }
+
+  cpu->need_resched = 1;
+  if (target != self)
+  {
+    smp_send_reschedule(target);
   }
 }
 
-static void process_trampoline(void)
+static void process_make_runnable(process_t *process)
 {
-  process_t *process = &processes[current_process];
-  if (process->entry)
+  wait_unlink(process);
+  if (process->state == PROCESS_RUNNABLE)
   {
-    process->entry(process->arg);
+    return;
   }
-  processes[current_process].kill_requested = 1;
-  process_yield();
-  for (;;)
+  process->state = PROCESS_RUNNABLE;
+  if (process->active)
   {
+    runq_push(process);
+    process_kick(process);
   }
 }
 
-void process_init(void)
+/*
+ * Runs on whichever CPU takes the tick, after timer_tick has unlinked the
+ * timer, so a cancel on another CPU may already have freed or reused the
+ * record. The timer carries the pid instead, and the wakeup only goes through
+ * if that process is still waiting on this same arming of its timer.
+ */
+static void process_timeout(void *arg)
 {
-  process_total = 1;
-  current_process = 0;
-  process_ticks = 0;
-  processes[0].name = "kernel";
-  processes[0].entry = 0;
-  processes[0].arg = 0;
-  processes[0].sp = 0;
-  processes[0].stack_base = 0;
-  processes[0].stack_size = 0;
-  processes[0].pid = 1;
-  processes[0].used = 1;
-  processes[0].kill_requested = 0;
-  processes[0].reap = 0;
-  processes[0].active = 1;
+  uint32_t flags = sched_lock();
+  process_t *process = pid_lookup((uint32_t)(uintptr_t)arg);
+  if (process && process->timeout_armed && !timer_pending(&process->sleep_timer))
+  {
+    process->timeout_armed = 0;
+    process_make_runnable(process);
+  }
+  sched_unlock(flags);
 }
 
-int process_create(const char *name, void (*entry)(void *), void *arg, size_t stack_size)
+/* Exited records are kept for reuse so spawning skips the heap walk. */
+static process_t *record_alloc(void)
 {
-  if (!entry || stack_size < 256)
+  process_t *process = process_free_records;
+  if (process)
   {
-    return -1;
+    process_free_records = process->zombie_next;
+    process_free_record_count--;
+    return process;
   }
+  return (process_t *)kmalloc(sizeof(process_t));
+}
 
-  size_t slot = find_free_slot();
-  if (slot >= MAX_PROCESSES)
+static void record_free(process_t *process)
+{
+  if (!process)
   {
-    return -1;
+    return;
+  }
+  if (process_free_record_count >= PROCESS_RECORD_CACHE_MAX)
+  {
+    kfree(process);
+    return;
   }
+  process->zombie_next = process_free_records;
+  process_free_records = process;
+  process_free_record_count++;
+}
+
+static void process_cleanup(process_t *process)
+{
+  /* A callback already in flight finds the pid gone and does nothing. */
+  process->timeout_armed = 0;
+  timer_cancel(&process->sleep_timer);
+  wait_unlink(process);
+  runq_remove(process);
+  index_remove(process);
 
-  uint8_t *stack = (uint8_t *)kmalloc(stack_size);
-  if (!stack)
+  process_table[process->slot] = 0;
+  process_free_slots[process_free_count++] = process->slot;
+
+  for (uint32_t i = 0; i < SMP_MAX_CPUS; ++i)
   {
-    return -1;
+    if (sched_cpus[i].fpu_loaded == process)
+    {
+      sched_cpus[i].fpu_loaded = 0;
+    }
   }
+  kfree(process->fpu_state);
+  arena_release(&process->arena);
+
+  stack_pool_free(process->stack_base, process->stack_size);
+  record_free(process);
+}
+
+/*
+ * Zombies are queued by the scheduler when a process with a pending kill
+ * gives up the CPU, and freed by whoever runs next: a process can never
+ * release the stack it is still running on.
+ */
+static void reap_zombies(void)
+{
+  while (zombie_list)
+  {
+    process_t *zombie = zombie_list;
+    zombie_list = zombie->zombie_next;
+    const char *name = zombie->name;
+    process_cleanup(zombie);
+    process_on_exit(name);
+  }
+}
+
+static void process_idle_loop(void *arg);
+
+static void process_trampoline(void)
+{
+  /*
+   * New processes are entered from the scheduler with interrupts off and
+   * the scheduler lock inherited from whoever switched to them.
+   */
+  process_t *self = this_cpu()->current;
+  sched_depth = 1;
+  reap_zombies();
+  sched_unlock(0);
+  cpu_irq_enable();
+
+  if (self->entry)
+  {
+    self->entry(self->arg);
+  }
+  self->kill_requested = 1;
+  process_yield();
+  for (;;)
+  {
+  }
+}
+
+static void process_setup(process_t *process, const char *name, uint32_t pid)
+{
+  process->name = name;
+  process->entry = 0;
+  process->arg = 0;
+  process->sp = 0;
+  process->stack_base = 0;
+  process->stack_size = 0;
+  process->pid = pid;
+  process->slot = 0;
+  process->kill_requested = 0;
+  process->reap = 0;
+  process->active = 1;
+  process->state = PROCESS_RUNNABLE;
+  timer_setup(&process->sleep_timer, process_timeout, (void *)(uintptr_t)pid);
+  process->timeout_armed = 0;
+  process->wait_on = 0;
+  process->wait_next = 0;
+  process->wait_prev = 0;
+  process->priority = PROCESS_PRIO_DEFAULT;
+  process->queued = 0;
+  process->cpu = 0;
+  process->lock_depth = 0;
+  process->runq_next = 0;
+  process->runq_prev = 0;
+  process->zombie_next = 0;
+  process->pid_next = 0;
+  process->name_next = 0;
+  process->run_start = clock_cycles();
+  process->run_cycles = 0;
+  process->queued_at = 0;
+  process->wait_cycles = 0;
+  process->switches = 0;
+  process->voluntary_switches = 0;
+  process->involuntary_switches = 0;
+  process->fpu_state = 0;
+  process->fpu_cpu = FPU_CPU_NONE;
+  process->fpu_live = 0;
+  arena_init(&process->arena);
+}
+
+static void sched_cpu_init(uint32_t index)
+{
+  sched_cpu_t *cpu = &sched_cpus[index];
+  process_setup(&cpu->idle, "idle", 0);
+  cpu->idle.active = 0;
+  cpu->idle.cpu = (uint8_t)index;
+  cpu->current = 0;
+  cpu->online = 0;
+  for (size_t i = 0; i < PROCESS_PRIORITIES; ++i)
+  {
+    cpu->run_queues[i].head = 0;
+    cpu->run_queues[i].tail = 0;
+  }
+  cpu->run_queue_bitmap = 0;
+  cpu->nr_queued = 0;
+  cpu->slice_left = process_timeslice;
+  cpu->need_resched = 0;
+  cpu->fpu_loaded = 0;
+}
 
+/* Lays out the frame switch_context pops the first time a stack runs. */
+static uint32_t *process_initial_frame(uint8_t *stack, size_t stack_size)
+{
+  stack_paint(stack, stack_size);
   uintptr_t top = (uintptr_t)(stack + stack_size);
   top &= ~((uintptr_t)0x0F);
   uint32_t *sp = (uint32_t *)top;
@@ -169,157 +692,596 @@ int process_create(const char *name, void (*entry)(void *), void *arg, size_t st
   *--sp = 0;                            /* EBP */
   *--sp = 0;                            /* ESI */
   *--sp = 0;                            /* EDI */
+  return sp;
+}
+
+void process_init(void)
+{
+  process_table = 0;
+  process_capacity = 0;
+  process_total = 0;
+  process_free_slots = 0;
+  process_free_count = 0;
+  for (size_t i = 0; i < PROCESS_PID_BUCKETS; ++i)
+  {
+    process_pid_hash[i] = 0;
+  }
+  for (size_t i = 0; i < PROCESS_NAME_BUCKETS; ++i)
+  {
+    process_name_hash[i] = 0;
+  }
+  process_next_pid = KERNEL_PID + 1;
+  zombie_list = 0;
+  process_free_records = 0;
+  process_free_record_count = 0;
+  stack_pool_init();
+  for (uint32_t i = 0; i < SMP_MAX_CPUS; ++i)
+  {
+    sched_cpu_init(i);
+  }
+  process_ticks = 0;
+  fpu_lazy = cpu_fpu_init() == 0;
+  if (fpu_lazy)
+  {
+    cpu_fpu_trap_next();
+  }
+
+  process_setup(&kernel_process, "kernel", KERNEL_PID);
+  sched_cpus[0].current = &kernel_process;
+  sched_cpus[0].online = 1;
+  if (alloc_slot(&kernel_process.slot) == 0)
+  {
+    process_table[kernel_process.slot] = &kernel_process;
+  }
+  index_insert(&kernel_process);
 
-  processes[slot].name = name;
-  processes[slot].entry = entry;
-  processes[slot].arg = arg;
-  processes[slot].sp = sp;
-  processes[slot].stack_base = stack;
-  processes[slot].stack_size = stack_size;
-  processes[slot].pid = alloc_pid();
-  processes[slot].used = 1;
-  processes[slot].kill_requested = 0;
-  processes[slot].reap = 0;
-  processes[slot].active = 1;
+  /* The boot CPU's idle loop needs a stack of its own: boot code blocks. */
+  size_t idle_stack_size = STACK_POOL_SMALL;
+  uint8_t *idle_stack = stack_pool_alloc(&idle_stack_size);
+  PANIC_IF(!idle_stack, "no memory for the idle stack");
+  process_t *idle = &sched_cpus[0].idle;
+  idle->entry = process_idle_loop;
+  idle->stack_base = idle_stack;
+  idle->stack_size = idle_stack_size;
+  idle->sp = process_initial_frame(idle_stack, idle_stack_size);
+}
+
+void process_ap_start(uint32_t cpu_index)
+{
+  uint32_t flags = sched_lock();
+  sched_cpu_t *cpu = &sched_cpus[cpu_index];
+  cpu->current = &cpu->idle;
+  cpu->online = 1;
+  sched_unlock(flags);
 
-  if (slot == process_total)
+  if (fpu_lazy)
   {
-    process_total++;
+    PANIC_IF(cpu_fpu_init() != 0, "AP lacks FXSAVE/SSE");
+    cpu_fpu_trap_next();
   }
+
+  /* The AP's boot stack becomes its idle stack. */
+  cpu_irq_disable();
+  process_idle_loop(0);
+}
+
+int process_create(const char *name, void (*entry)(void *), void *arg, size_t stack_size)
+{
+  if (!entry || stack_size < 256)
+  {
+    return -1;
+  }
+
+  uint32_t flags = sched_lock();
+  process_t *process = record_alloc();
+  uint8_t *stack = stack_pool_alloc(&stack_size);
+  size_t slot = 0;
+  if (!process || !stack || alloc_slot(&slot) != 0)
+  {
+    stack_pool_free(stack, stack_size);
+    record_free(process);
+    sched_unlock(flags);
+    return -1;
+  }
+
+  process_setup(process, name, alloc_pid());
+  process->entry = entry;
+  process->arg = arg;
+  process->sp = process_initial_frame(stack, stack_size);
+  process->stack_base = stack;
+  process->stack_size = stack_size;
+  process->slot = slot;
+  process->cpu = (uint8_t)smp_cpu_id();
+  process_table[slot] = process;
+  index_insert(process);
+  runq_push(process);
+  process_kick(process);
+
+  sched_unlock(flags);
   return 0;
 }
 
-void process_yield(void)
+/*
+ * Lazy FPU switching: the outgoing process saves only if it touched the FPU
+ * this slice, and the incoming one traps on first use unless this CPU's
+ * registers still hold its latest state.
+ */
+static void fpu_switch(sched_cpu_t *cpu, uint32_t self, process_t *prev, process_t *next)
 {
-  process_ticks++;
-  watchdog_kick();
-  if (process_total <= 1)
+  if (prev->fpu_live)
   {
-    return;
+    cpu_fxsave(prev->fpu_state);
+    prev->fpu_live = 0;
   }
+  if (next->fpu_state && cpu->fpu_loaded == next && next->fpu_cpu == self)
+  {
+    cpu_fpu_allow();
+    next->fpu_live = 1;
+  }
+  else
+  {
+    cpu_fpu_trap_next();
+  }
+}
 
-  if (current_process != 0 && processes[current_process].kill_requested)
+int process_fpu_trap(void)
+{
+  if (!fpu_lazy)
   {
-    processes[current_process].active = 0;
-    processes[current_process].reap = 1;
+    return -1;
   }
 
-  size_t next = current_process;
-  for (size_t i = 0; i < process_total; ++i)
+  uint32_t flags = sched_lock();
+  uint32_t self = smp_cpu_id();
+  sched_cpu_t *cpu = &sched_cpus[self];
+  process_t *process = cpu->current;
+  cpu_fpu_allow();
+  if (!process->fpu_state)
   {
-    next = (next + 1) % process_total;
-    if (processes[next].active)
+    process->fpu_state = (uint8_t *)kmalloc_aligned(FPU_STATE_SIZE, FPU_STATE_ALIGN);
+    if (!process->fpu_state)
     {
-      break;
+      sched_unlock(flags);
+      return -1;
     }
+    cpu_fpu_reset();
+  }
+  else if (cpu->fpu_loaded != process || process->fpu_cpu != self)
+  {
+    cpu_fxrstor(process->fpu_state);
+  }
+  cpu->fpu_loaded = process;
+  process->fpu_cpu = (uint8_t)self;
+  process->fpu_live = 1;
+  sched_unlock(flags);
+  return 0;
+}
+
+/*
+ * Must be called with the scheduler lock held. preempted is set when the
+ * timer takes the CPU away, as opposed to the process yielding or blocking.
+ * With nothing runnable the CPU switches to its idle process.
+ */
+static void process_schedule(int preempted)
+{
+  uint32_t self = smp_cpu_id();
+  sched_cpu_t *cpu = &sched_cpus[self];
+  process_t *prev = cpu->current;
+  prev->run_cycles += clock_cycles() - prev->run_start;
+
+  process_ticks++;
+  cpu->slice_left = process_timeslice;
+  cpu->need_resched = 0;
+  watchdog_kick();
+
+  if (prev != &kernel_process && prev->kill_requested && !prev->reap)
+  {
+    prev->active = 0;
+    prev->reap = 1;
+    prev->zombie_next = zombie_list;
+    zombie_list = prev;
+  }
+  else if (prev->active && prev->state == PROCESS_RUNNABLE)
+  {
+    runq_push(prev);
   }
 
-  if (next == current_process || !processes[next].active)
+  process_t *next = runq_pop(self);
+  if (!next)
+  {
+    next = &cpu->idle;
+  }
+  next->run_start = clock_cycles();
+  if (next == prev)
   {
     reap_zombies();
     return;
   }
 
-  size_t prev = current_process;
-  current_process = next;
-  switch_context(&processes[prev].sp, processes[next].sp);
+  /* The kernel process runs on the boot stack, which is not painted. */
+  PANIC_IF(prev->stack_base && !stack_guard_intact(prev->stack_base),
+           "Stack overflow detected at context switch");
 
-  if (prev != 0 && processes[prev].reap)
+  prev->switches++;
+  if (preempted)
   {
-    const char *name = processes[prev].name;
-    process_cleanup(prev);
-    process_on_exit(name);
+    prev->involuntary_switches++;
+  }
+  else
+  {
+    prev->voluntary_switches++;
+  }
+
+  if (fpu_lazy)
+  {
+    fpu_switch(cpu, self, prev, next);
   }
 
+  cpu->current = next;
+  prev->lock_depth = sched_depth;
+  switch_context(&prev->sp, next->sp);
+  /* Possibly on another CPU now, which switched here holding the lock. */
+  sched_depth = prev->lock_depth;
+
   reap_zombies();
 }
 
-void process_run(void)
+/*
+ * Each CPU's idle process: halt until there is work, including work another
+ * CPU could spare. Interrupts stay off except inside the halt itself, so a
+ * wakeup IPI cannot slip in between the check and the HLT. Idle time also
+ * unmaps retired stacks and slides movable buffers together, a slice at a
+ * time, ahead of each check.
+ */
+static void process_idle_loop(void *arg)
 {
+  (void)arg;
+  cpu_irq_disable();
   for (;;)
   {
-    process_yield();
+    stack_pool_reclaim();
+    int compacting = movable_compact_step(PROCESS_IDLE_COMPACT_BYTES);
+    uint32_t flags = sched_lock();
+    int work = runq_has_work(smp_cpu_id());
+    if (work)
+    {
+      process_schedule(0);
+    }
+    sched_unlock(flags);
+    if (!work && !compacting)
+    {
+      cpu_idle();
+    }
   }
 }
 
-size_t process_count(void)
+void *process_alloc(size_t size)
 {
-  return process_total;
+  /* The arena's own lock keeps a forced kill from releasing it mid-bump. */
+  return arena_alloc(&process_self()->arena, size);
 }
 
-int process_is_used(size_t index)
+void process_yield(void)
 {
-  if (index >= process_total)
+  uint32_t flags = sched_lock();
+  process_schedule(0);
+  sched_unlock(flags);
+}
+
+void process_sleep_ms(uint32_t ms)
+{
+  uint32_t flags = sched_lock();
+  process_t *self = this_cpu()->current;
+  self->timeout_armed = 1;
+  timer_start(&self->sleep_timer, ms);
+  self->state = PROCESS_SLEEPING;
+  process_schedule(0);
+  /* Woken early (e.g. by a kill request): drop the pending wakeup. */
+  self->timeout_armed = 0;
+  timer_cancel(&self->sleep_timer);
+  sched_unlock(flags);
+}
+
+void wait_queue_init(wait_queue_t *wq)
+{
+  wq->head = 0;
+  wq->tail = 0;
+}
+
+int wait_queue_sleep(wait_queue_t *wq, uint32_t timeout_ms)
+{
+  process_t *self = this_cpu()->current;
+
+  self->wait_on = wq;
+  self->wait_next = 0;
+  self->wait_prev = wq->tail;
+  if (wq->tail)
   {
-    return 0;
+    wq->tail->wait_next = self;
   }
-  return processes[index].used;
+  else
+  {
+    wq->head = self;
+  }
+  wq->tail = self;
+
+  if (timeout_ms)
+  {
+    self->timeout_armed = 1;
+    timer_start(&self->sleep_timer, timeout_ms);
+  }
+  self->state = PROCESS_BLOCKED;
+  process_schedule(0);
+
+  /* Still queued means we were woken by the timeout or a kill request. */
+  int woken = self->wait_on == 0;
+  wait_unlink(self);
+  if (timeout_ms)
+  {
+    self->timeout_armed = 0;
+    timer_cancel(&self->sleep_timer);
+  }
+  return woken ? 0 : -1;
 }
 
-const char *process_name(size_t index)
+int wake_up_one(wait_queue_t *wq)
 {
-  if (index >= process_total)
+  uint32_t flags = sched_lock();
+  process_t *process = wq->head;
+  if (process)
   {
-    return 0;
+    process_make_runnable(process);
   }
-  return processes[index].name;
+  sched_unlock(flags);
+  return process ? 1 : 0;
 }
 
-int process_is_active(size_t index)
+int wake_up(wait_queue_t *wq)
 {
-  if (index >= process_total)
+  int woken = 0;
+  uint32_t flags = sched_lock();
+  while (wq->head)
   {
-    return 0;
+    process_make_runnable(wq->head);
+    woken++;
   }
-  return processes[index].active;
+  sched_unlock(flags);
+  return woken;
 }
 
-int process_is_kill_requested(size_t index)
+struct process *process_self(void)
 {
-  if (index >= process_total)
+  uint32_t flags = cpu_irq_save();
+  process_t *self = this_cpu()->current;
+  cpu_irq_restore(flags);
+  return self;
+}
+
+uint32_t process_current_pid(void)
+{
+  return process_self()->pid;
+}
+
+void process_timer_tick(void)
+{
+  uint32_t flags = sched_lock();
+  sched_cpu_t *cpu = this_cpu();
+  process_timer_ticks++;
+
+  /* The idle loop rescans on its own once the interrupt returns. */
+  if (cpu->current == &cpu->idle)
   {
-    return 0;
+    process_idle_ticks++;
+    sched_unlock(flags);
+    return;
+  }
+
+  if (cpu->slice_left > 0)
+  {
+    cpu->slice_left--;
   }
-  return processes[index].kill_requested;
+  if (cpu->slice_left == 0 || cpu->need_resched)
+  {
+    process_schedule(1);
+  }
+  sched_unlock(flags);
 }
 
-uint32_t process_pid(size_t index)
+void process_reschedule(void)
 {
-  if (index >= process_total)
+  uint32_t flags = sched_lock();
+  sched_cpu_t *cpu = this_cpu();
+  if (cpu->current != &cpu->idle && cpu->need_resched)
+  {
+    process_schedule(1);
+  }
+  sched_unlock(flags);
+}
+
+void process_idle_stats(uint64_t *idle_ticks, uint64_t *total_ticks)
+{
+  uint32_t flags = sched_lock();
+  if (idle_ticks)
+  {
+    *idle_ticks = process_idle_ticks;
+  }
+  if (total_ticks)
+  {
+    *total_ticks = process_timer_ticks;
+  }
+  sched_unlock(flags);
+}
+
+void process_set_timeslice(uint32_t ticks)
+{
+  if (ticks == 0)
+  {
+    ticks = 1;
+  }
+  uint32_t flags = sched_lock();
+  process_timeslice = ticks;
+  for (uint32_t i = 0; i < SMP_MAX_CPUS; ++i)
+  {
+    if (sched_cpus[i].slice_left > ticks)
+    {
+      sched_cpus[i].slice_left = ticks;
+    }
+  }
+  sched_unlock(flags);
+}
+
+int process_set_priority(uint32_t pid, uint8_t priority)
+{
+  if (priority >= PROCESS_PRIORITIES)
+  {
+    return -1;
+  }
+
+  uint32_t flags = sched_lock();
+  process_t *process = pid_lookup(pid);
+  if (!process)
+  {
+    sched_unlock(flags);
+    return -1;
+  }
+  int queued = process->queued;
+  runq_remove(process);
+  process->priority = priority;
+  if (queued)
+  {
+    runq_push(process);
+    process_kick(process);
+  }
+  sched_unlock(flags);
+  return 0;
+}
+
+uint32_t process_get_timeslice(void)
+{
+  return process_timeslice;
+}
+
+void process_run(void)
+{
+  for (;;)
+  {
+    process_yield();
+  }
+}
+
+size_t process_count(void)
+{
+  return process_total;
+}
+
+int process_snapshot(size_t index, process_info_t *info)
+{
+  if (!info)
+  {
+    return -1;
+  }
+
+  uint32_t flags = sched_lock();
+  process_t *process = process_at(index);
+  if (!process)
+  {
+    sched_unlock(flags);
+    return -1;
+  }
+
+  str_copy(info->name, sizeof(info->name), process->name);
+  info->state = process->state;
+  info->priority = process->priority;
+  info->active = (uint8_t)process->active;
+  info->kill_requested = (uint8_t)process->kill_requested;
+
+  process_stats_t *out = &info->stats;
+  uint64_t now = clock_cycles();
+  uint64_t run = process->run_cycles;
+  uint64_t wait = process->wait_cycles;
+  if (process_running(process))
+  {
+    run += now - process->run_start;
+  }
+  if (process->queued)
+  {
+    wait += now - process->queued_at;
+  }
+  out->pid = process->pid;
+  out->stack_size = process->stack_size;
+  out->stack_used = process->stack_base
+                        ? stack_high_water(process->stack_base, process->stack_size)
+                        : 0;
+  out->run_ns = clock_cycles_to_ns(run);
+  out->wait_ns = clock_cycles_to_ns(wait);
+  out->switches = process->switches;
+  out->voluntary_switches = process->voluntary_switches;
+  out->involuntary_switches = process->involuntary_switches;
+  out->arena_used = process->arena.used;
+  out->arena_reserved = process->arena.reserved;
+  sched_unlock(flags);
+  return 0;
+}
+
+uint32_t process_find(const char *name)
+{
+  if (!name)
   {
     return 0;
   }
-  return processes[index].pid;
+
+  uint32_t flags = sched_lock();
+  process_t *process = process_name_hash[name_hash(name) & (PROCESS_NAME_BUCKETS - 1)];
+  while (process && !(process->name && name_eq(process->name, name)))
+  {
+    process = process->name_next;
+  }
+  uint32_t pid = process ? process->pid : 0;
+  sched_unlock(flags);
+  return pid;
 }
 
 int process_kill(uint32_t pid, int force)
 {
-  if (pid == 1 && !force)
+  if (pid == KERNEL_PID && !force)
   {
     return -1;
   }
 
-  for (size_t i = 0; i < process_total; ++i)
+  uint32_t flags = sched_lock();
+  process_t *process = pid_lookup(pid);
+  if (!process)
   {
-    if (processes[i].used && processes[i].pid == pid)
-    {
-      if (force && i != current_process)
-      {
-        const char *name = processes[i].name;
-        process_cleanup(i);
-        process_on_exit(name);
-        return 0;
-      }
+    sched_unlock(flags);
+    return -1;
+  }
 
-      processes[i].kill_requested = 1;
-      return 0;
-    }
+  if (process->reap)
+  {
+    /* Already a zombie; the next context switch frees it. */
+    sched_unlock(flags);
+    return 0;
   }
 
-  return -1;
+  if (force && !process_running(process) && process != &kernel_process)
+  {
+    const char *name = process->name;
+    process_cleanup(process);
+    process_on_exit(name);
+    sched_unlock(flags);
+    return 0;
+  }
+
+  process->kill_requested = 1;
+  process_make_runnable(process);
+  sched_unlock(flags);
+  return 0;
 }
 
 uint64_t process_get_ticks(void)
 {
-  return process_ticks;
+  uint32_t flags = sched_lock();
+  uint64_t ticks = process_ticks;
+  sched_unlock(flags);
+  return ticks;
 }
@@ -0,0 +1,353 @@
+#include "proc/stack.h"
+#include "arch/spinlock.h"
+#include "mm/heap.h"
+#include "mm/page.h"
+#include "mm/vmm.h"
+
+#define STACK_CLASS_SMALL 0
+#define STACK_CLASS_MEDIUM 1
+#define STACK_CLASS_LARGE 2
+#define STACK_CLASS_COUNT 3
+
+/* Stacks ready at boot so the first spawns never touch the heap. */
+#define STACK_POOL_PREFILL 2
+
+/*
+ * Stacks are mapped into fixed slots of the stack window. The lowest page of
+ * a slot is never mapped, so running off the bottom of a stack faults there.
+ */
+#define STACK_SLOT_SIZE 0x10000u
+#define STACK_SLOT_COUNT (VMM_STACK_SIZE / STACK_SLOT_SIZE)
+
+/* Free stacks are linked through their own (unused) memory. */
+typedef struct stack_free
+{
+  struct stack_free *next;
+  size_t size;
+} stack_free_t;
+
+static stack_free_t *stack_free_lists[STACK_CLASS_COUNT];
+static size_t stack_free_counts[STACK_CLASS_COUNT];
+static size_t stack_pool_hits;
+static size_t stack_pool_misses;
+static uint32_t stack_slots[STACK_SLOT_COUNT / 32];
+/* Stacks a full class turned away, still mapped until stack_pool_reclaim. */
+static stack_free_t *stack_retired;
+static spinlock_t stack_pool_lock = SPINLOCK_INIT;
+
+static size_t stack_round(size_t size)
+{
+  if (size <= STACK_POOL_SMALL)
+  {
+    return STACK_POOL_SMALL;
+  }
+  if (size <= STACK_POOL_MEDIUM)
+  {
+    return STACK_POOL_MEDIUM;
+  }
+  return (size + STACK_POOL_MEDIUM - 1) & ~(size_t)(STACK_POOL_MEDIUM - 1);
+}
+
+static int stack_class(size_t size)
+{
+  if (size == STACK_POOL_SMALL)
+  {
+    return STACK_CLASS_SMALL;
+  }
+  if (size == STACK_POOL_MEDIUM)
+  {
+    return STACK_CLASS_MEDIUM;
+  }
+  return STACK_CLASS_LARGE;
+}
+
+/* Call with stack_pool_lock held. */
+static uint8_t *stack_take(int cls, size_t size)
+{
+  stack_free_t **link = &stack_free_lists[cls];
+  while (*link)
+  {
+    stack_free_t *entry = *link;
+    if (entry->size == size)
+    {
+      *link = entry->next;
+      stack_free_counts[cls]--;
+      return (uint8_t *)entry;
+    }
+    /* Only the large class can hold mixed sizes. */
+    link = &entry->next;
+  }
+  return 0;
+}
+
+/* Call with stack_pool_lock held. Returns -1 if the class is full. */
+static int stack_put(uint8_t *base, size_t size)
+{
+  int cls = stack_class(size);
+  if (stack_free_counts[cls] >= STACK_POOL_CACHE_MAX)
+  {
+    return -1;
+  }
+
+  stack_free_t *entry = (stack_free_t *)base;
+  entry->next = stack_free_lists[cls];
+  entry->size = size;
+  stack_free_lists[cls] = entry;
+  stack_free_counts[cls]++;
+  return 0;
+}
+
+static int stack_is_mapped(const uint8_t *base)
+{
+  return (uintptr_t)base >= VMM_STACK_BASE && (uintptr_t)base - VMM_STACK_BASE < VMM_STACK_SIZE;
+}
+
+/*
+ * Call with stack_pool_lock held. A mapped stack is only queued: unmapping
+ * waits on every CPU, which stack_pool_reclaim does with no lock held.
+ */
+static void stack_discard(uint8_t *base, size_t size)
+{
+  if (!stack_is_mapped(base))
+  {
+    kfree(base);
+    return;
+  }
+
+  stack_free_t *entry = (stack_free_t *)base;
+  entry->next = stack_retired;
+  entry->size = size;
+  stack_retired = entry;
+}
+
+static void slot_release(uintptr_t base)
+{
+  size_t slot = (base - VMM_STACK_BASE) / STACK_SLOT_SIZE;
+  uint32_t flags = spin_lock_irqsave(&stack_pool_lock);
+  stack_slots[slot / 32] &= ~(1u << (slot % 32));
+  spin_unlock_irqrestore(&stack_pool_lock, flags);
+}
+
+/* Maps size bytes above a guard page; 0 if there is no slot or no memory. */
+static uint8_t *stack_map(size_t size)
+{
+  size_t pages = (size + PAGE_SIZE - 1) / PAGE_SIZE;
+  if (pages > STACK_SLOT_SIZE / PAGE_SIZE - 1)
+  {
+    return 0;
+  }
+
+  uint32_t flags = spin_lock_irqsave(&stack_pool_lock);
+  size_t slot = STACK_SLOT_COUNT;
+  for (size_t i = 0; i < STACK_SLOT_COUNT; ++i)
+  {
+    if (!(stack_slots[i / 32] & (1u << (i % 32))))
+    {
+      stack_slots[i / 32] |= 1u << (i % 32);
+      slot = i;
+      break;
+    }
+  }
+  spin_unlock_irqrestore(&stack_pool_lock, flags);
+  if (slot == STACK_SLOT_COUNT)
+  {
+    return 0;
+  }
+
+  uintptr_t base = VMM_STACK_BASE + slot * STACK_SLOT_SIZE + PAGE_SIZE;
+  for (size_t i = 0; i < pages; ++i)
+  {
+    phys_addr_t frame = page_alloc(0);
+    if (frame && vmm_map(base + i * PAGE_SIZE, frame, VMM_WRITE) == 0)
+    {
+      continue;
+    }
+    if (frame)
+    {
+      page_free(frame, 0);
+    }
+    /* Pages already mapped go the same way as a retired stack. */
+    if (i == 0)
+    {
+      slot_release(base);
+      return 0;
+    }
+    flags = spin_lock_irqsave(&stack_pool_lock);
+    stack_discard((uint8_t *)base, i * PAGE_SIZE);
+    spin_unlock_irqrestore(&stack_pool_lock, flags);
+    return 0;
+  }
+  return (uint8_t *)base;
+}
+
+static void stack_unmap(uint8_t *base, size_t size)
+{
+  uintptr_t virt = (uintptr_t)base;
+  for (size_t offset = 0; offset < size; offset += PAGE_SIZE)
+  {
+    phys_addr_t frame = vmm_translate(virt + offset);
+    if (frame && vmm_unmap(virt + offset) == 0)
+    {
+      page_free(frame, 0);
+    }
+  }
+  slot_release(virt);
+}
+
+/* A guarded stack when a slot is free, a heap block with only the canary otherwise. */
+static uint8_t *stack_obtain(size_t size)
+{
+  uint8_t *base = stack_map(size);
+  return base ? base : (uint8_t *)kmalloc(size);
+}
+
+static void stack_prefill(size_t size)
+{
+  for (int i = 0; i < STACK_POOL_PREFILL; ++i)
+  {
+    uint8_t *base = stack_obtain(size);
+    if (!base)
+    {
+      return;
+    }
+    /* Touch every byte now rather than on first use. */
+    stack_paint(base, size);
+    if (stack_put(base, size) != 0)
+    {
+      stack_discard(base, size);
+      return;
+    }
+  }
+}
+
+void stack_pool_init(void)
+{
+  for (int i = 0; i < STACK_CLASS_COUNT; ++i)
+  {
+    stack_free_lists[i] = 0;
+    stack_free_counts[i] = 0;
+  }
+  for (size_t i = 0; i < STACK_SLOT_COUNT / 32; ++i)
+  {
+    stack_slots[i] = 0;
+  }
+  stack_retired = 0;
+  stack_pool_hits = 0;
+  stack_pool_misses = 0;
+
+  stack_prefill(STACK_POOL_SMALL);
+  stack_prefill(STACK_POOL_MEDIUM);
+}
+
+uint8_t *stack_pool_alloc(size_t *size)
+{
+  if (!size || *size == 0)
+  {
+    return 0;
+  }
+
+  size_t rounded = stack_round(*size);
+  uint32_t flags = spin_lock_irqsave(&stack_pool_lock);
+  uint8_t *base = stack_take(stack_class(rounded), rounded);
+  if (base)
+  {
+    stack_pool_hits++;
+  }
+  else
+  {
+    stack_pool_misses++;
+  }
+  spin_unlock_irqrestore(&stack_pool_lock, flags);
+
+  if (!base)
+  {
+    base = stack_obtain(rounded);
+  }
+
+  if (base)
+  {
+    *size = rounded;
+  }
+  return base;
+}
+
+void stack_pool_free(uint8_t *base, size_t size)
+{
+  if (!base)
+  {
+    return;
+  }
+
+  uint32_t flags = spin_lock_irqsave(&stack_pool_lock);
+  if (stack_put(base, size) != 0)
+  {
+    stack_discard(base, size);
+  }
+  spin_unlock_irqrestore(&stack_pool_lock, flags);
+}
+
+void stack_pool_reclaim(void)
+{
+  uint32_t flags = spin_lock_irqsave(&stack_pool_lock);
+  stack_free_t *entry = stack_retired;
+  stack_retired = 0;
+  spin_unlock_irqrestore(&stack_pool_lock, flags);
+
+  while (entry)
+  {
+    stack_free_t *next = entry->next;
+    stack_unmap((uint8_t *)entry, entry->size);
+    entry = next;
+  }
+}
+
+void stack_pool_get_stats(stack_pool_stats_t *out)
+{
+  if (!out)
+  {
+    return;
+  }
+
+  uint32_t flags = spin_lock_irqsave(&stack_pool_lock);
+  for (int i = 0; i < STACK_CLASS_COUNT; ++i)
+  {
+    out->cached[i] = stack_free_counts[i];
+  }
+  out->hits = stack_pool_hits;
+  out->misses = stack_pool_misses;
+  spin_unlock_irqrestore(&stack_pool_lock, flags);
+}
+
+void stack_paint(uint8_t *base, size_t size)
+{
+  uint32_t *word = (uint32_t *)base;
+  for (size_t i = 0; i < size / sizeof(uint32_t); ++i)
+  {
+    word[i] = STACK_CANARY;
+  }
+}
+
+int stack_guard_intact(const uint8_t *base)
+{
+  const uint32_t *word = (const uint32_t *)base;
+  for (size_t i = 0; i < STACK_GUARD_BYTES / sizeof(uint32_t); ++i)
+  {
+    if (word[i] != STACK_CANARY)
+    {
+      return 0;
+    }
+  }
+  return 1;
+}
+
+size_t stack_high_water(const uint8_t *base, size_t size)
+{
+  const uint32_t *word = (const uint32_t *)base;
+  size_t words = size / sizeof(uint32_t);
+  size_t untouched = 0;
+  while (untouched < words && word[untouched] == STACK_CANARY)
+  {
+    untouched++;
+  }
+  return size - untouched * sizeof(uint32_t);
+}
@@ -0,0 +1,111 @@
+#include "proc/sync.h"
+#include "proc/process.h"
+
+void mutex_init(mutex_t *mutex)
+{
+  mutex->locked = 0;
+  mutex->owner = 0;
+  wait_queue_init(&mutex->waiters);
+}
+
+void mutex_lock(mutex_t *mutex)
+{
+  uint32_t flags = sched_lock();
+  while (mutex->locked)
+  {
+    (void)wait_queue_sleep(&mutex->waiters, 0);
+  }
+  mutex->locked = 1;
+  mutex->owner = process_self();
+  sched_unlock(flags);
+}
+
+int mutex_trylock(mutex_t *mutex)
+{
+  uint32_t flags = sched_lock();
+  if (mutex->locked)
+  {
+    sched_unlock(flags);
+    return -1;
+  }
+  mutex->locked = 1;
+  mutex->owner = process_self();
+  sched_unlock(flags);
+  return 0;
+}
+
+static void mutex_release(mutex_t *mutex)
+{
+  mutex->locked = 0;
+  mutex->owner = 0;
+  (void)wake_up_one(&mutex->waiters);
+}
+
+void mutex_unlock(mutex_t *mutex)
+{
+  uint32_t flags = sched_lock();
+  mutex_release(mutex);
+  sched_unlock(flags);
+}
+
+void semaphore_init(semaphore_t *sem, int count)
+{
+  sem->count = count;
+  wait_queue_init(&sem->waiters);
+}
+
+void semaphore_wait(semaphore_t *sem)
+{
+  uint32_t flags = sched_lock();
+  while (sem->count <= 0)
+  {
+    (void)wait_queue_sleep(&sem->waiters, 0);
+  }
+  sem->count--;
+  sched_unlock(flags);
+}
+
+int semaphore_trywait(semaphore_t *sem)
+{
+  uint32_t flags = sched_lock();
+  if (sem->count <= 0)
+  {
+    sched_unlock(flags);
+    return -1;
+  }
+  sem->count--;
+  sched_unlock(flags);
+  return 0;
+}
+
+void semaphore_post(semaphore_t *sem)
+{
+  uint32_t flags = sched_lock();
+  sem->count++;
+  (void)wake_up_one(&sem->waiters);
+  sched_unlock(flags);
+}
+
+void condvar_init(condvar_t *cv)
+{
+  wait_queue_init(&cv->waiters);
+}
+
+void condvar_wait(condvar_t *cv, mutex_t *mutex)
+{
+  uint32_t flags = sched_lock();
+  mutex_release(mutex);
+  (void)wait_queue_sleep(&cv->waiters, 0);
+  sched_unlock(flags);
+  mutex_lock(mutex);
+}
+
+void condvar_signal(condvar_t *cv)
+{
+  (void)wake_up_one(&cv->waiters);
+}
+
+void condvar_broadcast(condvar_t *cv)
+{
+  (void)wake_up(&cv->waiters);
+}
@@ -0,0 +1,199 @@
+#include "proc/task.h"
+#include "proc/process.h"
+#include "proc/wait.h"
+
+#define TASK_EXECUTOR_STACK_SIZE 2048
+
+/* Ready FIFO and the list of live tasks, both under the scheduler lock. */
+static task_t *task_ready_head;
+static task_t *task_ready_tail;
+static task_t *task_all;
+static size_t task_total;
+static wait_queue_t task_waiters = WAIT_QUEUE_INIT;
+
+static void task_timer_fire(void *arg)
+{
+  task_wake((task_t *)arg);
+}
+
+/* Call with the scheduler lock held. */
+static void task_enqueue(task_t *task)
+{
+  if (task->queued || !task->active)
+  {
+    return;
+  }
+  task->queued = 1;
+  task->next = 0;
+  if (task_ready_tail)
+  {
+    task_ready_tail->next = task;
+  }
+  else
+  {
+    task_ready_head = task;
+  }
+  task_ready_tail = task;
+  (void)wake_up_one(&task_waiters);
+}
+
+/* Call with the scheduler lock held. */
+static void task_unready(task_t *task)
+{
+  task_t **link = &task_ready_head;
+  task_t *prev = 0;
+  while (*link && *link != task)
+  {
+    prev = *link;
+    link = &(*link)->next;
+  }
+  if (*link)
+  {
+    *link = task->next;
+    if (task_ready_tail == task)
+    {
+      task_ready_tail = prev;
+    }
+  }
+  task->next = 0;
+  task->queued = 0;
+}
+
+static task_t *task_dequeue(void)
+{
+  uint32_t flags = sched_lock();
+  task_t *task = task_ready_head;
+  if (task)
+  {
+    task_ready_head = task->next;
+    if (!task_ready_head)
+    {
+      task_ready_tail = 0;
+    }
+    task->next = 0;
+    task->queued = 0;
+  }
+  sched_unlock(flags);
+  return task;
+}
+
+static void task_forget(task_t *task)
+{
+  uint32_t flags = sched_lock();
+  task_t **link = &task_all;
+  while (*link && *link != task)
+  {
+    link = &(*link)->all_next;
+  }
+  if (*link)
+  {
+    *link = task->all_next;
+    task_total--;
+  }
+  task->all_next = 0;
+  task->active = 0;
+  task_unready(task);
+  sched_unlock(flags);
+}
+
+static void task_executor(void *arg)
+{
+  (void)arg;
+  for (;;)
+  {
+    wait_event(task_waiters, task_ready_head != 0);
+    task_t *task = task_dequeue();
+    if (!task || !task->active)
+    {
+      continue;
+    }
+
+    int result = task->fn(task);
+    if (result == TASK_DONE)
+    {
+      (void)timer_cancel(&task->timer);
+      task_forget(task);
+    }
+    else if (result == TASK_YIELDED)
+    {
+      task_wake(task);
+    }
+  }
+}
+
+int task_executor_init(void)
+{
+  task_ready_head = 0;
+  task_ready_tail = 0;
+  task_all = 0;
+  task_total = 0;
+
+  if (process_create("tasks", task_executor, 0, TASK_EXECUTOR_STACK_SIZE) != 0)
+  {
+    return -1;
+  }
+  /* Hosts the watchdog check, so it must not starve behind normal work. */
+  return process_set_priority(process_find("tasks"), PROCESS_PRIO_HIGH);
+}
+
+void task_spawn(task_t *task, const char *name, task_fn_t fn, void *arg)
+{
+  task_cancel(task);
+  timer_setup(&task->timer, task_timer_fire, task);
+  task->fn = fn;
+  task->arg = arg;
+  task->name = name;
+  task->resume = 0;
+
+  uint32_t flags = sched_lock();
+  task->active = 1;
+  task->all_next = task_all;
+  task_all = task;
+  task_total++;
+  task_enqueue(task);
+  sched_unlock(flags);
+}
+
+void task_cancel(task_t *task)
+{
+  if (!task->active)
+  {
+    return;
+  }
+  task_forget(task);
+  (void)timer_cancel(&task->timer);
+}
+
+void task_wake(task_t *task)
+{
+  uint32_t flags = sched_lock();
+  task_enqueue(task);
+  sched_unlock(flags);
+}
+
+void task_sleep_ms(task_t *task, uint32_t ms)
+{
+  timer_start(&task->timer, ms);
+}
+
+size_t task_count(void)
+{
+  uint32_t flags = sched_lock();
+  size_t count = task_total;
+  sched_unlock(flags);
+  return count;
+}
+
+size_t task_list(const char **names, int *ready, size_t max)
+{
+  size_t count = 0;
+  uint32_t flags = sched_lock();
+  for (task_t *task = task_all; task && count < max; task = task->all_next)
+  {
+    names[count] = task->name;
+    ready[count] = task->queued;
+    count++;
+  }
+  sched_unlock(flags);
+  return count;
+}
@@ -0,0 +1,120 @@
+#include "proc/workqueue.h"
+#include "proc/process.h"
+#include "proc/wait.h"
+#include "arch/smp.h"
+
+#define WORKER_STACK_SIZE 2048
+
+/* FIFO of pending items, guarded by the scheduler lock like the wait queue. */
+static work_t *work_head;
+static work_t *work_tail;
+static size_t work_count;
+static wait_queue_t work_waiters = WAIT_QUEUE_INIT;
+
+static const char *const worker_names[WORKQUEUE_MAX_WORKERS] = {
+    "kworker/0",
+    "kworker/1",
+    "kworker/2",
+    "kworker/3",
+};
+
+void work_init(work_t *work, work_fn_t fn, void *arg)
+{
+  work->next = 0;
+  work->fn = fn;
+  work->arg = arg;
+  work->pending = 0;
+}
+
+int queue_work(work_t *work)
+{
+  if (!work || !work->fn)
+  {
+    return -1;
+  }
+
+  uint32_t flags = sched_lock();
+  if (work->pending)
+  {
+    sched_unlock(flags);
+    return -1;
+  }
+  work->pending = 1;
+  work->next = 0;
+  if (work_tail)
+  {
+    work_tail->next = work;
+  }
+  else
+  {
+    work_head = work;
+  }
+  work_tail = work;
+  work_count++;
+  (void)wake_up_one(&work_waiters);
+  sched_unlock(flags);
+  return 0;
+}
+
+size_t workqueue_pending(void)
+{
+  uint32_t flags = sched_lock();
+  size_t count = work_count;
+  sched_unlock(flags);
+  return count;
+}
+
+static work_t *work_dequeue(void)
+{
+  uint32_t flags = sched_lock();
+  work_t *work = work_head;
+  if (work)
+  {
+    work_head = work->next;
+    if (!work_head)
+    {
+      work_tail = 0;
+    }
+    work_count--;
+    work->next = 0;
+    /* Cleared before the run so the item can requeue itself. */
+    work->pending = 0;
+  }
+  sched_unlock(flags);
+  return work;
+}
+
+static void worker_process(void *arg)
+{
+  (void)arg;
+  for (;;)
+  {
+    wait_event(work_waiters, work_head != 0);
+    work_t *work = work_dequeue();
+    if (work)
+    {
+      work->fn(work->arg);
+    }
+  }
+}
+
+int workqueue_init(void)
+{
+  work_head = 0;
+  work_tail = 0;
+  work_count = 0;
+
+  uint32_t workers = smp_cpu_count();
+  if (workers > WORKQUEUE_MAX_WORKERS)
+  {
+    workers = WORKQUEUE_MAX_WORKERS;
+  }
+  for (uint32_t i = 0; i < workers; ++i)
+  {
+    if (process_create(worker_names[i], worker_process, 0, WORKER_STACK_SIZE) != 0)
+    {
+      return -1;
+    }
+  }
+  return 0;
+}
@@ -7,30 +7,35 @@
 #include "sys/services.h"
 #include "drivers/keyboard.h"
 #include "sys/power.h"
-#include "sys/watchdog.h"
 #include "mm/heap.h"
+#include "mm/page.h"
+#include "mm/slab.h"
+#include "mm/movable.h"
+#include "proc/stack.h"
+#include "proc/task.h"
+#include "sys/clock.h"
+#include "arch/cpu.h"
+#include "lib/string.h"
+#include "lib/format.h"
 
 #define SHELL_LINE_MAX 64
 #define SHELL_HISTORY_MAX 8
-
-static char shell_history[SHELL_HISTORY_MAX][SHELL_LINE_MAX];
+#define SHELL_TOP_REFRESH_MS 500
+#define SHELL_TAIL_WAIT_MS 100
+#define SHELL_TOP_MAX 32
+#define SHELL_BENCH_ITERATIONS 32
+#define SHELL_TASKS_MAX 16
+#define SHELL_PROFILE_TOP 8
+#define SHELL_BENCH_COPY_BYTES 4096
+
+/* History lines are movable buffers, oldest first, each sized to fit. */
+static movable_t shell_history[SHELL_HISTORY_MAX];
+/* Line and bench buffers come from the shell process's arena and go with it. */
+static uint8_t *shell_bench_src;
+static uint8_t *shell_bench_dst;
 static size_t shell_history_len;
 static size_t shell_history_pos;
 
-static int str_eq(const char *a, const char *b)
-{
-  while (*a && *b)
-  {
-    if (*a != *b)
-    {
-      return 0;
-    }
-    a++;
-    b++;
-  }
-  return *a == '\0' && *b == '\0';
-}
-
 static int str_starts_with(const char *s, const char *prefix)
 {
   while (*prefix)
@@ -58,20 +63,15 @@ static int parse_int(const char *s)
   return value;
 }
 
-static size_t copy_line(char *dst, size_t dst_len, const char *src)
+static size_t history_fetch(size_t index, char *out, size_t out_len)
 {
-  size_t i = 0;
-  if (dst_len == 0)
+  if (index >= shell_history_len || out_len == 0)
   {
     return 0;
   }
-  while (src && src[i] && i < dst_len - 1)
-  {
-    dst[i] = src[i];
-    i++;
-  }
-  dst[i] = '\0';
-  return i;
+  size_t len = movable_read(shell_history[index], out, out_len - 1);
+  out[len] = '\0';
+  return len;
 }
 
 static void history_add(const char *line)
@@ -81,79 +81,68 @@ static void history_add(const char *line)
     return;
   }
 
-  if (shell_history_len > 0 && str_eq(shell_history[shell_history_len - 1], line))
+  char last[SHELL_LINE_MAX];
+  if (shell_history_len > 0 &&
+      history_fetch(shell_history_len - 1, last, sizeof(last)) > 0 && str_eq(last, line))
   {
     return;
   }
 
-  if (shell_history_len < SHELL_HISTORY_MAX)
+  movable_t text = movable_store(line, strlen(line));
+  if (text == MOVABLE_NONE)
   {
-    copy_line(shell_history[shell_history_len], SHELL_LINE_MAX, line);
-    shell_history_len++;
     return;
   }
-
-  for (size_t i = 1; i < SHELL_HISTORY_MAX; ++i)
+  if (shell_history_len == SHELL_HISTORY_MAX)
   {
-    copy_line(shell_history[i - 1], SHELL_LINE_MAX, shell_history[i]);
-  }
-  copy_line(shell_history[SHELL_HISTORY_MAX - 1], SHELL_LINE_MAX, line);
-}
-
-static uint64_t u64_div_u32(uint64_t value, uint32_t divisor, uint32_t *remainder)
-{
-  uint64_t quotient = 0;
-  uint64_t rem = 0;
-
-  for (int i = 63; i >= 0; --i)
-  {
-    rem = (rem << 1) | ((value >> i) & 1u);
-    if (rem >= divisor)
+    movable_free(shell_history[0]);
+    for (size_t i = 1; i < SHELL_HISTORY_MAX; ++i)
     {
-      rem -= divisor;
-      quotient |= (1ull << i);
+      shell_history[i - 1] = shell_history[i];
     }
+    shell_history_len--;
   }
-
-  if (remainder)
-  {
-    *remainder = (uint32_t)rem;
-  }
-  return quotient;
+  shell_history[shell_history_len++] = text;
 }
 
 static void print_uint64(uint64_t value)
 {
-  char buf[21];
-  size_t i = 0;
+  char buf[FMT_U64_MAX];
+  fmt_u64(buf, value);
+  terminal_write(buf);
+}
 
-  if (value == 0)
-  {
-    terminal_write("0");
-    return;
-  }
+static void print_hex32(uint32_t value)
+{
+  char buf[FMT_HEX32_MAX];
+  fmt_hex32(buf, value);
+  terminal_write(buf);
+}
 
-  while (value > 0 && i < sizeof(buf) - 1)
+static void print_uint_width(uint64_t value, size_t width, char pad)
+{
+  char buf[FMT_U64_MAX];
+  size_t digits = fmt_u64(buf, value);
+  while (digits < width)
   {
-    uint32_t rem = 0;
-    value = u64_div_u32(value, 10, &rem);
-    buf[i++] = (char)('0' + rem);
+    terminal_write((char[]){pad, '\0'});
+    digits++;
   }
+  terminal_write(buf);
+}
 
-  while (i > 0)
-  {
-    terminal_write((char[]){buf[--i], '\0'});
-  }
+static void print_timestamp(uint64_t ns)
+{
+  uint32_t rem_ns = 0;
+  uint64_t secs = u64_div_u32(ns, CLOCK_NS_PER_SEC, &rem_ns);
+  print_uint_width(secs, 5, ' ');
+  terminal_write(".");
+  print_uint_width(rem_ns / CLOCK_NS_PER_MS, 3, '0');
 }
 
 static void print_padded(const char *text, size_t width)
 {
-  size_t len = 0;
-  while (text && text[len])
-  {
-    len++;
-  }
-
+  size_t len = text ? strlen(text) : 0;
   if (text)
   {
     terminal_write(text);
@@ -166,28 +155,6 @@ static void print_padded(const char *text, size_t width)
   }
 }
 
-static uint32_t find_process_pid(const char *name, size_t *index_out)
-{
-  size_t count = process_count();
-  for (size_t i = 0; i < count; ++i)
-  {
-    if (!process_is_used(i))
-    {
-      continue;
-    }
-    const char *proc_name = process_name(i);
-    if (proc_name && str_eq(proc_name, name))
-    {
-      if (index_out)
-      {
-        *index_out = i;
-      }
-      return process_pid(i);
-    }
-  }
-  return 0;
-}
-
 static const char *log_level_name(uint8_t level)
 {
   switch (level)
@@ -226,6 +193,17 @@ static int log_matches_service(const log_entry_t *entry, const char *service)
   return is_service_log(entry->msg, service);
 }
 
+static void print_log_entry(const log_entry_t *entry)
+{
+  set_log_color(entry->level);
+  terminal_write("[");
+  print_timestamp(entry->time_ns);
+  terminal_write("] [");
+  terminal_write(log_level_name(entry->level));
+  terminal_write("] ");
+  terminal_writeln(entry->msg);
+}
+
 static void shell_logs_print(const char *service)
 {
   log_entry_t entry;
@@ -237,11 +215,7 @@ static void shell_logs_print(const char *service)
   {
     if (log_matches_service(&entry, service))
     {
-      set_log_color(entry.level);
-      terminal_write("[");
-      terminal_write(log_level_name(entry.level));
-      terminal_write("] ");
-      terminal_writeln(entry.msg);
+      print_log_entry(&entry);
       found = 1;
     }
     seq++;
@@ -269,7 +243,6 @@ static void shell_logs_tail(const char *service)
   vga_set_color(prev_color & 0x0F, (uint8_t)(prev_color >> 4));
   for (;;)
   {
-    watchdog_kick();
     int key = keyboard_poll_key();
     if (key == 3)
     {
@@ -281,18 +254,15 @@ static void shell_logs_tail(const char *service)
     {
       if (log_matches_service(&entry, service))
       {
-        set_log_color(entry.level);
-        terminal_write("[");
-        terminal_write(log_level_name(entry.level));
-        terminal_write("] ");
-        terminal_writeln(entry.msg);
+        print_log_entry(&entry);
         vga_set_color(prev_color & 0x0F, (uint8_t)(prev_color >> 4));
       }
       seq++;
       continue;
     }
 
-    process_yield();
+    /* Ctrl+C is only noticed between waits, so keep the timeout short. */
+    (void)log_wait(seq, SHELL_TAIL_WAIT_MS);
   }
 }
 
@@ -300,17 +270,18 @@ static void shell_processes(void)
 {
   uint8_t prev_color = vga_get_color();
   vga_set_color(0x0B, 0x00);
-  terminal_writeln("PID  STATE    NAME");
+  terminal_writeln("PID  PRI  STATE    STACK       ARENA   NAME");
   vga_set_color(prev_color & 0x0F, (uint8_t)(prev_color >> 4));
   size_t count = process_count();
   for (size_t i = 0; i < count; ++i)
   {
-    if (!process_is_used(i))
+    process_info_t info;
+    if (process_snapshot(i, &info) != 0)
     {
       continue;
     }
-    const char *name = process_name(i);
-    uint32_t pid = process_pid(i);
+    const process_stats_t *stats = &info.stats;
+    uint32_t pid = stats->pid;
     terminal_write(" ");
     if (pid < 10)
     {
@@ -322,20 +293,159 @@ static void shell_processes(void)
     }
     print_uint64(pid);
     terminal_write("  ");
-    if (process_is_kill_requested(i))
+    print_uint64(info.priority);
+    terminal_write("   ");
+    if (info.kill_requested)
     {
       terminal_write("killing ");
     }
+    else if (info.state == PROCESS_BLOCKED)
+    {
+      terminal_write("blocked ");
+    }
+    else if (info.state == PROCESS_SLEEPING)
+    {
+      terminal_write("sleep   ");
+    }
     else
     {
-      terminal_write(process_is_active(i) ? "running " : "stopped ");
+      terminal_write(info.active ? "running " : "stopped ");
+    }
+    /* High-water mark out of the stack size; the kernel stack is untracked. */
+    terminal_write(" ");
+    if (stats->stack_size != 0)
+    {
+      print_uint_width(stats->stack_used, 5, ' ');
+      terminal_write("/");
+      print_uint_width(stats->stack_size, 5, ' ');
+      terminal_write(" ");
     }
-    terminal_writeln(name ? name : "(null)");
+    else
+    {
+      terminal_write("    -/    - ");
+    }
+    /* Bytes handed out from the process arena, released in bulk on exit. */
+    if (stats->arena_reserved != 0)
+    {
+      print_uint_width(stats->arena_used, 7, ' ');
+      terminal_write(" ");
+    }
+    else
+    {
+      terminal_write("      - ");
+    }
+    terminal_writeln(info.name[0] ? info.name : "(null)");
   }
 }
 
+static void shell_tasks(void)
+{
+  const char *names[SHELL_TASKS_MAX];
+  int ready[SHELL_TASKS_MAX];
+  size_t count = task_list(names, ready, SHELL_TASKS_MAX);
+
+  uint8_t prev_color = vga_get_color();
+  vga_set_color(0x0B, 0x00);
+  terminal_writeln("STATE    NAME");
+  vga_set_color(prev_color & 0x0F, (uint8_t)(prev_color >> 4));
+  for (size_t i = 0; i < count; ++i)
+  {
+    terminal_write(ready[i] ? "ready    " : "waiting  ");
+    terminal_writeln(names[i] ? names[i] : "(null)");
+  }
+  terminal_write("task_t size: ");
+  print_uint64(sizeof(task_t));
+  terminal_writeln(" bytes");
+}
+
+static void print_idle_percent(uint64_t idle_delta, uint64_t total_delta)
+{
+  terminal_write("CPU idle: ");
+  if (total_delta == 0)
+  {
+    terminal_writeln("-");
+    return;
+  }
+  uint64_t pct = u64_div_u32(idle_delta * 100u, (uint32_t)total_delta, 0);
+  print_uint64(pct);
+  terminal_writeln("%");
+}
+
+static uint32_t top_prev_pid[SHELL_TOP_MAX];
+static uint64_t top_prev_run_ns[SHELL_TOP_MAX];
+static size_t top_prev_rows;
+
+static void print_cpu_percent(uint64_t run_delta, uint64_t elapsed)
+{
+  if (elapsed == 0 || (elapsed >> 32) != 0)
+  {
+    terminal_write("   -");
+    return;
+  }
+  uint64_t pct = u64_div_u32(run_delta * 100u, (uint32_t)elapsed, 0);
+  if (pct > 100)
+  {
+    pct = 100;
+  }
+  print_uint_width(pct, 3, ' ');
+  terminal_write("%");
+}
+
+/* Per-process CPU share since the previous refresh, from TSC run time. */
+static void shell_top_processes(uint64_t elapsed)
+{
+  terminal_writeln(" PID  %CPU   RUN ms  WAIT ms   VCSW  ICSW  NAME");
+  size_t count = process_count();
+  size_t row = 0;
+  for (size_t i = 0; i < count && row < SHELL_TOP_MAX; ++i)
+  {
+    process_info_t info;
+    if (process_snapshot(i, &info) != 0)
+    {
+      continue;
+    }
+    const process_stats_t stats = info.stats;
+
+    /* Slot indices are reused, so only compare against the same pid. */
+    int have_prev = row < top_prev_rows && top_prev_pid[row] == stats.pid &&
+                    stats.run_ns >= top_prev_run_ns[row];
+    uint64_t prev_run = have_prev ? top_prev_run_ns[row] : 0;
+    top_prev_pid[row] = stats.pid;
+    top_prev_run_ns[row] = stats.run_ns;
+    row++;
+
+    print_uint_width(stats.pid, 4, ' ');
+    terminal_write("  ");
+    if (!have_prev)
+    {
+      terminal_write("   -");
+    }
+    else
+    {
+      print_cpu_percent(stats.run_ns - prev_run, elapsed);
+    }
+    terminal_write(" ");
+    print_uint_width(u64_div_u32(stats.run_ns, CLOCK_NS_PER_MS, 0), 8, ' ');
+    terminal_write(" ");
+    print_uint_width(u64_div_u32(stats.wait_ns, CLOCK_NS_PER_MS, 0), 8, ' ');
+    terminal_write(" ");
+    print_uint_width(stats.voluntary_switches, 6, ' ');
+    terminal_write(" ");
+    print_uint_width(stats.involuntary_switches, 5, ' ');
+    terminal_write("  ");
+    terminal_writeln(info.name[0] ? info.name : "(null)");
+  }
+  top_prev_rows = row;
+}
+
 static void shell_top(void)
 {
+  uint64_t prev_idle = 0;
+  uint64_t prev_total = 0;
+  uint64_t prev_ns = clock_ns();
+  process_idle_stats(&prev_idle, &prev_total);
+  top_prev_rows = 0;
+
   terminal_writeln("-- top-lite (Ctrl+C to exit) --");
   for (;;)
   {
@@ -346,15 +456,59 @@ static void shell_top(void)
       return;
     }
 
+    uint64_t idle = 0;
+    uint64_t total = 0;
+    uint64_t now = clock_ns();
+    process_idle_stats(&idle, &total);
+
     terminal_clear();
-    shell_processes();
+    print_idle_percent(idle - prev_idle, total - prev_total);
+    terminal_writeln("");
+    shell_top_processes(now - prev_ns);
     terminal_writeln("");
     terminal_writeln("Ctrl+C to exit");
+    /* Only rows that differ from the last frame reach the screen. */
+    vga_flush();
 
-    for (uint32_t i = 0; i < 20000; ++i)
-    {
-      process_yield();
-    }
+    prev_idle = idle;
+    prev_total = total;
+    prev_ns = now;
+    process_sleep_ms(SHELL_TOP_REFRESH_MS);
+  }
+}
+
+static void shell_uptime(void)
+{
+  terminal_write("up ");
+  print_timestamp(clock_ns());
+  terminal_writeln(" s");
+
+  clock_datetime_t now;
+  clock_datetime(&now);
+  terminal_write("date: ");
+  print_uint64(now.year);
+  terminal_write("-");
+  print_uint_width(now.month, 2, '0');
+  terminal_write("-");
+  print_uint_width(now.day, 2, '0');
+  terminal_write(" ");
+  print_uint_width(now.hour, 2, '0');
+  terminal_write(":");
+  print_uint_width(now.minute, 2, '0');
+  terminal_write(":");
+  print_uint_width(now.second, 2, '0');
+  terminal_writeln(" UTC");
+
+  terminal_write("tsc: ");
+  uint32_t khz = clock_tsc_khz();
+  if (khz)
+  {
+    print_uint64(khz);
+    terminal_writeln(" kHz");
+  }
+  else
+  {
+    terminal_writeln("unavailable (PIT clock)");
   }
 }
 
@@ -419,13 +573,17 @@ static void shell_help(void)
   terminal_writeln("  color <fg> <bg> Set VGA color (0-15)");
   terminal_writeln("  ps              List processes");
   terminal_writeln("  top             Process monitor");
+  terminal_writeln("  tasks           List stackless kernel tasks");
   terminal_writeln("  kill <pid> [-f]  Kill process");
   terminal_writeln("  services        List services");
   terminal_writeln("  services <name> status|start|stop|restart|info");
   terminal_writeln("  logs            View system logs");
   terminal_writeln("  logs <service>  View service logs");
   terminal_writeln("  logs -t [name]  Tail logs (system or service)");
-  terminal_writeln("  mem             Show heap stats");
+  terminal_writeln("  mem             Show heap and page stats");
+  terminal_writeln("  heapprof [reset] Sampled kmalloc call sites");
+  terminal_writeln("  uptime          Show uptime and RTC time");
+  terminal_writeln("  bench           Allocator, spawn and lib microbenchmarks");
   terminal_writeln("  panic <msg>     Trigger panic screen");
   terminal_writeln("  reboot          Reboot the system");
   terminal_writeln("  shutdown        Power off (QEMU)");
@@ -443,7 +601,9 @@ static void shell_mem(void)
 
   terminal_write("  total: ");
   print_uint64(stats.total_bytes);
-  terminal_writeln(" bytes");
+  terminal_write(" bytes in ");
+  print_uint64(stats.regions);
+  terminal_writeln(stats.regions == 1 ? " region" : " regions");
 
   terminal_write("  used:  ");
   print_uint64(stats.used_bytes);
@@ -474,6 +634,283 @@ static void shell_mem(void)
   terminal_write("  fragmentation: ");
   print_uint64(stats.frag_percent);
   terminal_writeln("%");
+
+  stack_pool_stats_t pool;
+  stack_pool_get_stats(&pool);
+  terminal_write("  stack pool: ");
+  print_uint64(pool.cached[0]);
+  terminal_write(" x 2K, ");
+  print_uint64(pool.cached[1]);
+  terminal_write(" x 4K, ");
+  print_uint64(pool.cached[2]);
+  terminal_write(" large, ");
+  print_uint64(pool.hits);
+  terminal_write(" hits / ");
+  print_uint64(pool.misses);
+  terminal_writeln(" misses");
+
+  terminal_writeln("  slab caches:  SIZE  SLABS   USED / TOTAL");
+  for (size_t i = 0; i < SLAB_CLASS_COUNT; ++i)
+  {
+    slab_cache_stats_t cache;
+    if (slab_cache_stats(i, &cache) != 0)
+    {
+      continue;
+    }
+    terminal_write("              ");
+    print_uint_width(cache.object_size, 5, ' ');
+    terminal_write(" ");
+    print_uint_width(cache.slabs, 6, ' ');
+    terminal_write(" ");
+    print_uint_width(cache.objects_used, 6, ' ');
+    terminal_write(" / ");
+    print_uint64(cache.objects_total);
+    terminal_writeln("");
+  }
+
+  page_stats_t pages;
+  page_get_stats(&pages);
+  terminal_write("  page frames: ");
+  print_uint64(pages.free_pages);
+  terminal_write(" free / ");
+  print_uint64(pages.total_pages);
+  terminal_write(" total (");
+  print_uint64(pages.total_pages >> (20 - PAGE_SHIFT));
+  terminal_writeln(" MiB)");
+  terminal_write("  free blocks by order:");
+  for (unsigned order = 0; order <= PAGE_MAX_ORDER; ++order)
+  {
+    terminal_write(" ");
+    print_uint64(pages.free_blocks[order]);
+  }
+  terminal_writeln("");
+
+  movable_stats_t movable;
+  movable_get_stats(&movable);
+  terminal_write("  movable zone: ");
+  print_uint64(movable.used_bytes);
+  terminal_write(" used / ");
+  print_uint64(movable.zone_bytes);
+  terminal_write(" bytes, ");
+  print_uint64(movable.hole_bytes);
+  terminal_write(" in holes, ");
+  print_uint64(movable.handles);
+  terminal_write(" handles, ");
+  print_uint64(movable.moves);
+  terminal_write(" moves in ");
+  print_uint64(movable.passes);
+  terminal_writeln(" passes");
+}
+
+static void shell_heapprof(const char *args)
+{
+  if (str_eq(args, "reset"))
+  {
+    heap_profile_reset();
+    terminal_writeln("heap profile reset");
+    return;
+  }
+
+  heap_profile_t profile;
+  heap_profile_get(&profile);
+  terminal_write("allocations: ");
+  print_uint64(profile.allocations);
+  terminal_write(", sampled 1/");
+  print_uint64(HEAP_PROFILE_SAMPLE_EVERY);
+  terminal_write(": ");
+  print_uint64(profile.samples);
+  terminal_writeln("");
+  terminal_write("in use: ");
+  print_uint64(profile.in_use);
+  terminal_write(" bytes, peak: ");
+  print_uint64(profile.peak);
+  terminal_writeln(" bytes");
+
+  terminal_writeln("sampled sizes:");
+  for (uint32_t i = 0; i < HEAP_PROFILE_BUCKETS; ++i)
+  {
+    if (profile.size_buckets[i] == 0)
+    {
+      continue;
+    }
+    terminal_write(i == HEAP_PROFILE_BUCKETS - 1 ? "     > " : "  <= ");
+    print_uint_width(i == HEAP_PROFILE_BUCKETS - 1 ? (16u << (i - 1)) : (16u << i), 5, ' ');
+    terminal_write(": ");
+    print_uint64(profile.size_buckets[i]);
+    terminal_writeln("");
+  }
+
+  /* Bytes are scaled back up by the sampling rate, so they are estimates. */
+  heap_profile_site_t sites[SHELL_PROFILE_TOP];
+  size_t count = heap_profile_top(sites, SHELL_PROFILE_TOP);
+  uint8_t prev_color = vga_get_color();
+  vga_set_color(0x0B, 0x00);
+  terminal_writeln("CALLER      SAMPLES   ~BYTES");
+  vga_set_color(prev_color & 0x0F, (uint8_t)(prev_color >> 4));
+  for (size_t i = 0; i < count; ++i)
+  {
+    print_hex32((uint32_t)sites[i].site);
+    terminal_write("  ");
+    print_uint_width(sites[i].samples, 7, ' ');
+    terminal_write("  ");
+    print_uint64(sites[i].bytes * HEAP_PROFILE_SAMPLE_EVERY);
+    terminal_writeln("");
+  }
+  if (profile.dropped_sites)
+  {
+    terminal_write("(");
+    print_uint64(profile.dropped_sites);
+    terminal_writeln(" samples from untracked sites)");
+  }
+}
+
+static void print_bench_result(const char *label, uint64_t cycles)
+{
+  terminal_write(label);
+  print_uint64(u64_div_u32(clock_cycles_to_ns(cycles), SHELL_BENCH_ITERATIONS, 0));
+  terminal_writeln(" ns/op");
+}
+
+static void bench_noop(void *arg)
+{
+  (void)arg;
+}
+
+/* The per-byte loop modules used before lib/; volatile keeps it a loop. */
+static void bench_byte_copy(volatile uint8_t *dst, const uint8_t *src, size_t n)
+{
+  for (size_t i = 0; i < n; ++i)
+  {
+    dst[i] = src[i];
+  }
+}
+
+/* The shift-and-subtract division the old formatters ran once per digit. */
+static uint64_t bench_div_bitwise(uint64_t value, uint32_t divisor)
+{
+  uint64_t quotient = 0;
+  uint64_t rem = 0;
+  for (int i = 63; i >= 0; --i)
+  {
+    rem = (rem << 1) | ((value >> i) & 1u);
+    if (rem >= divisor)
+    {
+      rem -= divisor;
+      quotient |= (1ull << i);
+    }
+  }
+  return quotient;
+}
+
+/* Copies against the byte loop, and 64-bit formatting against the bit loop. */
+static void shell_bench_lib(void)
+{
+  if (!shell_bench_src)
+  {
+    shell_bench_src = (uint8_t *)process_alloc(SHELL_BENCH_COPY_BYTES);
+    shell_bench_dst = (uint8_t *)process_alloc(SHELL_BENCH_COPY_BYTES);
+  }
+  if (!shell_bench_src || !shell_bench_dst)
+  {
+    terminal_writeln("  no memory for the copy buffers");
+    return;
+  }
+
+  uint64_t start = clock_cycles();
+  for (int i = 0; i < SHELL_BENCH_ITERATIONS; ++i)
+  {
+    bench_byte_copy(shell_bench_dst, shell_bench_src, SHELL_BENCH_COPY_BYTES);
+  }
+  print_bench_result("  byte loop 4K:        ", clock_cycles() - start);
+
+  /* With interrupts masked memcpy stays on rep movsd. */
+  uint32_t flags = cpu_irq_save();
+  start = clock_cycles();
+  for (int i = 0; i < SHELL_BENCH_ITERATIONS; ++i)
+  {
+    memcpy(shell_bench_dst, shell_bench_src, SHELL_BENCH_COPY_BYTES);
+  }
+  uint64_t cycles = clock_cycles() - start;
+  cpu_irq_restore(flags);
+  print_bench_result("  memcpy 4K rep movsd: ", cycles);
+
+  start = clock_cycles();
+  for (int i = 0; i < SHELL_BENCH_ITERATIONS; ++i)
+  {
+    memcpy(shell_bench_dst, shell_bench_src, SHELL_BENCH_COPY_BYTES);
+  }
+  terminal_write("  memcpy 4K ");
+  print_padded(string_impl(), 9);
+  print_bench_result(": ", clock_cycles() - start);
+
+  volatile uint64_t sink = 0;
+  start = clock_cycles();
+  for (int i = 0; i < SHELL_BENCH_ITERATIONS; ++i)
+  {
+    for (uint64_t v = UINT64_MAX; v > 0; v = bench_div_bitwise(v, 10))
+    {
+      sink += v;
+    }
+  }
+  print_bench_result("  u64 digits bitwise:  ", clock_cycles() - start);
+
+  char buf[FMT_U64_MAX];
+  start = clock_cycles();
+  for (int i = 0; i < SHELL_BENCH_ITERATIONS; ++i)
+  {
+    sink += fmt_u64(buf, UINT64_MAX);
+  }
+  print_bench_result("  fmt_u64:             ", clock_cycles() - start);
+  (void)sink;
+}
+
+/* Spawn/exit latency, the stack pool against a plain heap round trip, a slab round trip and lib/. */
+static void shell_bench(void)
+{
+  uint64_t start = clock_cycles();
+  for (int i = 0; i < SHELL_BENCH_ITERATIONS; ++i)
+  {
+    kfree(kmalloc(STACK_POOL_SMALL));
+  }
+  print_bench_result("  kmalloc+kfree 2K:    ", clock_cycles() - start);
+
+  start = clock_cycles();
+  for (int i = 0; i < SHELL_BENCH_ITERATIONS; ++i)
+  {
+    kfree(kmalloc(64));
+  }
+  print_bench_result("  kmalloc+kfree 64B:   ", clock_cycles() - start);
+
+  start = clock_cycles();
+  for (int i = 0; i < SHELL_BENCH_ITERATIONS; ++i)
+  {
+    size_t size = STACK_POOL_SMALL;
+    stack_pool_free(stack_pool_alloc(&size), size);
+  }
+  print_bench_result("  stack pool 2K:       ", clock_cycles() - start);
+
+  uint64_t spawn = 0;
+  uint64_t total = 0;
+  for (int i = 0; i < SHELL_BENCH_ITERATIONS; ++i)
+  {
+    start = clock_cycles();
+    if (process_create("bench", bench_noop, 0, STACK_POOL_SMALL) != 0)
+    {
+      terminal_writeln("bench: spawn failed");
+      return;
+    }
+    spawn += clock_cycles() - start;
+    /* Outrank the shell so the child runs and exits on the next yield. */
+    process_set_priority(process_find("bench"), PROCESS_PRIO_HIGH);
+    while (process_find("bench") != 0)
+    {
+      process_yield();
+    }
+    total += clock_cycles() - start;
+  }
+  print_bench_result("  process_create:      ", spawn);
+  print_bench_result("  spawn+exit+reap:     ", total);
+  shell_bench_lib();
 }
 
 static int is_service_log(const char *msg, const char *name)
@@ -511,8 +948,7 @@ static void shell_services_list(void)
     terminal_write(" ");
     print_padded(name ? name : "(null)", 9);
     terminal_write(services_is_running(i) ? "running  " : "stopped  ");
-    size_t idx = 0;
-    uint32_t pid = name ? find_process_pid(name, &idx) : 0;
+    uint32_t pid = name ? process_find(name) : 0;
     if (pid)
     {
       print_uint64(pid);
@@ -543,8 +979,7 @@ static void shell_services_info(const char *name)
   terminal_write("  state: ");
   terminal_writeln(services_is_running(index) ? "running" : "stopped");
 
-  size_t proc_idx = 0;
-  uint32_t pid = find_process_pid(name, &proc_idx);
+  uint32_t pid = process_find(name);
   terminal_write("  pid: ");
   if (pid)
   {
@@ -607,8 +1042,7 @@ static void shell_services_status(const char *name)
   terminal_write(": ");
   terminal_writeln(services_is_running(index) ? "running" : "stopped");
 
-  size_t proc_idx = 0;
-  uint32_t pid = find_process_pid(name, &proc_idx);
+  uint32_t pid = process_find(name);
   if (pid)
   {
     terminal_write("pid: ");
@@ -816,6 +1250,12 @@ static void shell_handle_command(const char *line)
     return;
   }
 
+  if (str_eq(line, "tasks"))
+  {
+    shell_tasks();
+    return;
+  }
+
   if (str_starts_with(line, "kill"))
   {
     shell_kill(line);
@@ -840,6 +1280,24 @@ static void shell_handle_command(const char *line)
     return;
   }
 
+  if (str_eq(line, "uptime"))
+  {
+    shell_uptime();
+    return;
+  }
+
+  if (str_eq(line, "heapprof") || str_starts_with(line, "heapprof "))
+  {
+    shell_heapprof(line[8] ? line + 9 : "");
+    return;
+  }
+
+  if (str_eq(line, "bench"))
+  {
+    shell_bench();
+    return;
+  }
+
   if (str_eq(line, "reboot"))
   {
     terminal_writeln("Rebooting...");
@@ -869,8 +1327,13 @@ static void shell_handle_command(const char *line)
 
 void shell_run(void)
 {
-  char line[SHELL_LINE_MAX];
-  char scratch[SHELL_LINE_MAX];
+  char *line = (char *)process_alloc(SHELL_LINE_MAX);
+  char *scratch = (char *)process_alloc(SHELL_LINE_MAX);
+  if (!line || !scratch)
+  {
+    terminal_writeln("shell: no memory for the line buffers");
+    return;
+  }
 
   uint8_t prev_color = vga_get_color();
   vga_set_color(0x0B, 0x00);
@@ -880,11 +1343,11 @@ void shell_run(void)
   {
     terminal_write("os> ");
     shell_history_pos = shell_history_len;
-    terminal_readline_history(line, sizeof(line),
-                              (const char **)shell_history,
+    terminal_readline_history(line, SHELL_LINE_MAX,
+                              history_fetch,
                               shell_history_len,
                               &shell_history_pos,
-                              scratch, sizeof(scratch));
+                              scratch, SHELL_LINE_MAX);
     history_add(line);
     shell_handle_command(line);
   }
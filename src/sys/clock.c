@@ -0,0 +1,217 @@
+#include "sys/clock.h"
+#include "arch/cpu.h"
+#include "arch/io.h"
+#include "drivers/pit.h"
+#include "lib/div64.h"
+
+#define PIT_CHANNEL2 0x42
+#define PIT_CMD 0x43
+#define PIT_GATE_PORT 0x61
+
+/* One PIT channel 2 countdown of 50 ms (1193182 / 20). */
+#define CLOCK_CALIBRATE_COUNT 59659u
+#define CLOCK_CALIBRATE_PER_SEC 20u
+
+/* ns = (cycles * clock_mult) >> CLOCK_SHIFT */
+#define CLOCK_SHIFT 24
+
+#define CMOS_ADDR 0x70
+#define CMOS_DATA 0x71
+
+static int clock_use_tsc;
+static uint64_t clock_tsc_base;
+static uint32_t clock_mult;
+static uint32_t clock_khz;
+static uint64_t clock_boot_epoch;
+
+static uint32_t clock_calibrate_tsc(void)
+{
+  uint8_t gate = inb(PIT_GATE_PORT);
+
+  /* Gate channel 2 on, speaker off, mode 0 one-shot. */
+  outb(PIT_GATE_PORT, (uint8_t)((gate & ~0x02) & ~0x01));
+  outb(PIT_CMD, 0xB0);
+  outb(PIT_CHANNEL2, (uint8_t)(CLOCK_CALIBRATE_COUNT & 0xFF));
+  outb(PIT_CHANNEL2, (uint8_t)((CLOCK_CALIBRATE_COUNT >> 8) & 0xFF));
+
+  uint64_t start = cpu_rdtsc();
+  outb(PIT_GATE_PORT, (uint8_t)((gate & ~0x02) | 0x01));
+  while ((inb(PIT_GATE_PORT) & 0x20) == 0)
+  {
+  }
+  uint64_t end = cpu_rdtsc();
+
+  outb(PIT_GATE_PORT, gate);
+  return (uint32_t)(end - start);
+}
+
+static uint8_t cmos_read(uint8_t reg)
+{
+  outb(CMOS_ADDR, reg);
+  return inb(CMOS_DATA);
+}
+
+static uint8_t bcd_to_bin(uint8_t value)
+{
+  return (uint8_t)((value & 0x0F) + ((value >> 4) * 10));
+}
+
+static void rtc_read_raw(clock_datetime_t *out)
+{
+  while (cmos_read(0x0A) & 0x80)
+  {
+  }
+  out->second = cmos_read(0x00);
+  out->minute = cmos_read(0x02);
+  out->hour = cmos_read(0x04);
+  out->day = cmos_read(0x07);
+  out->month = cmos_read(0x08);
+  out->year = cmos_read(0x09);
+}
+
+static void rtc_read(clock_datetime_t *out)
+{
+  clock_datetime_t again;
+
+  /* Re-read until two samples agree so we never straddle an update. */
+  rtc_read_raw(out);
+  for (;;)
+  {
+    rtc_read_raw(&again);
+    if (again.second == out->second && again.minute == out->minute &&
+        again.hour == out->hour && again.day == out->day &&
+        again.month == out->month && again.year == out->year)
+    {
+      break;
+    }
+    *out = again;
+  }
+
+  uint8_t status_b = cmos_read(0x0B);
+  uint8_t pm = (uint8_t)(out->hour & 0x80);
+  out->hour &= 0x7F;
+  if (!(status_b & 0x04))
+  {
+    out->second = bcd_to_bin(out->second);
+    out->minute = bcd_to_bin(out->minute);
+    out->hour = bcd_to_bin(out->hour);
+    out->day = bcd_to_bin(out->day);
+    out->month = bcd_to_bin(out->month);
+    out->year = bcd_to_bin((uint8_t)out->year);
+  }
+  if (!(status_b & 0x02) && pm)
+  {
+    out->hour = (uint8_t)((out->hour + 12) % 24);
+  }
+  out->year = (uint16_t)(out->year + 2000);
+}
+
+/* Days since 1970-01-01 for a proleptic Gregorian date. */
+static uint32_t days_from_civil(uint32_t year, uint32_t month, uint32_t day)
+{
+  year -= month <= 2;
+  uint32_t era = year / 400;
+  uint32_t yoe = year - era * 400;
+  uint32_t mp = month > 2 ? month - 3 : month + 9;
+  uint32_t doy = (153 * mp + 2) / 5 + day - 1;
+  uint32_t doe = yoe * 365 + yoe / 4 - yoe / 100 + doy;
+  return era * 146097 + doe - 719468;
+}
+
+static void civil_from_days(uint32_t days, clock_datetime_t *out)
+{
+  uint32_t z = days + 719468;
+  uint32_t era = z / 146097;
+  uint32_t doe = z - era * 146097;
+  uint32_t yoe = (doe - doe / 1460 + doe / 36524 - doe / 146096) / 365;
+  uint32_t doy = doe - (365 * yoe + yoe / 4 - yoe / 100);
+  uint32_t mp = (5 * doy + 2) / 153;
+  uint32_t day = doy - (153 * mp + 2) / 5 + 1;
+  uint32_t month = mp < 10 ? mp + 3 : mp - 9;
+  out->year = (uint16_t)(yoe + era * 400 + (month <= 2));
+  out->month = (uint8_t)month;
+  out->day = (uint8_t)day;
+}
+
+void clock_init(void)
+{
+  clock_use_tsc = cpu_has_tsc();
+  if (clock_use_tsc)
+  {
+    uint32_t cycles = clock_calibrate_tsc();
+    clock_khz = cycles / (1000u / CLOCK_CALIBRATE_PER_SEC);
+    if (cycles == 0 || clock_khz == 0)
+    {
+      clock_use_tsc = 0;
+    }
+    else
+    {
+      uint64_t scaled = (uint64_t)(CLOCK_NS_PER_SEC / CLOCK_CALIBRATE_PER_SEC) << CLOCK_SHIFT;
+      clock_mult = (uint32_t)u64_div_u32(scaled, cycles, 0);
+      clock_tsc_base = cpu_rdtsc();
+    }
+  }
+
+  clock_datetime_t now;
+  rtc_read(&now);
+  clock_boot_epoch = (uint64_t)days_from_civil(now.year, now.month, now.day) * 86400u +
+                     (uint32_t)now.hour * 3600u + (uint32_t)now.minute * 60u + now.second;
+}
+
+uint64_t clock_cycles_to_ns(uint64_t cycles)
+{
+  if (!clock_use_tsc)
+  {
+    return cycles;
+  }
+  uint64_t hi = (cycles >> 32) * clock_mult;
+  uint64_t lo = (cycles & 0xFFFFFFFFu) * clock_mult;
+  return (hi << (32 - CLOCK_SHIFT)) + (lo >> CLOCK_SHIFT);
+}
+
+uint64_t clock_cycles(void)
+{
+  if (!clock_use_tsc)
+  {
+    return pit_ticks() * (CLOCK_NS_PER_SEC / PIT_TICK_HZ);
+  }
+  return cpu_rdtsc();
+}
+
+uint64_t clock_ns(void)
+{
+  if (!clock_use_tsc)
+  {
+    return pit_ticks() * (CLOCK_NS_PER_SEC / PIT_TICK_HZ);
+  }
+  return clock_cycles_to_ns(cpu_rdtsc() - clock_tsc_base);
+}
+
+uint64_t clock_ms(void)
+{
+  return u64_div_u32(clock_ns(), CLOCK_NS_PER_MS, 0);
+}
+
+uint32_t clock_tsc_khz(void)
+{
+  return clock_use_tsc ? clock_khz : 0;
+}
+
+uint64_t clock_epoch_seconds(void)
+{
+  return clock_boot_epoch + u64_div_u32(clock_ns(), CLOCK_NS_PER_SEC, 0);
+}
+
+void clock_datetime(clock_datetime_t *out)
+{
+  if (!out)
+  {
+    return;
+  }
+  uint32_t secs_of_day = 0;
+  uint64_t days = u64_div_u32(clock_epoch_seconds(), 86400u, &secs_of_day);
+  civil_from_days((uint32_t)days, out);
+  out->hour = (uint8_t)(secs_of_day / 3600u);
+  out->minute = (uint8_t)((secs_of_day / 60u) % 60u);
+  out->second = (uint8_t)(secs_of_day % 60u);
+}
@@ -1,20 +1,34 @@
 #include "sys/log.h"
-#include "proc/process.h"
+#include "sys/clock.h"
+#include "arch/spinlock.h"
+#include "proc/wait.h"
+#include "mm/movable.h"
+#include "lib/string.h"
+
+#include <stddef.h>
 
 #define LOG_CAPACITY 128
 
-static log_entry_t log_buf[LOG_CAPACITY];
-static uint64_t log_seq;
+/*
+ * Short text stays in the record. Longer text, up to 63 bytes, goes in the
+ * movable zone sized to fit; if the zone is full it is cut to the inline part.
+ */
+#define LOG_INLINE_MAX 16
+#define LOG_MSG_MAX (sizeof(((log_entry_t *)0)->msg))
 
-static void log_copy_msg(char *dst, const char *src)
+typedef struct
 {
-  size_t i = 0;
-  for (; src[i] != '\0' && i < sizeof(log_buf[0].msg) - 1; ++i)
-  {
-    dst[i] = src[i];
-  }
-  dst[i] = '\0';
-}
+  uint64_t seq;
+  uint64_t time_ns;
+  uint8_t level;
+  movable_t text;
+  char inline_msg[LOG_INLINE_MAX];
+} log_record_t;
+
+static log_record_t log_buf[LOG_CAPACITY];
+static uint64_t log_seq;
+static wait_queue_t log_waiters = WAIT_QUEUE_INIT;
+static spinlock_t log_lock = SPINLOCK_INIT;
 
 void log_init(void)
 {
@@ -23,12 +37,30 @@ void log_init(void)
 
 void log_write(log_level_t level, const char *msg)
 {
-  log_entry_t *entry = &log_buf[log_seq % LOG_CAPACITY];
-  entry->seq = log_seq;
-  entry->tick = process_get_ticks();
-  entry->level = (uint8_t)level;
-  log_copy_msg(entry->msg, msg ? msg : "");
+  if (!msg)
+  {
+    msg = "";
+  }
+  size_t len = strlen(msg);
+  if (len > LOG_MSG_MAX - 1)
+  {
+    len = LOG_MSG_MAX - 1;
+  }
+  movable_t text = len >= LOG_INLINE_MAX ? movable_store(msg, len) : MOVABLE_NONE;
+
+  uint32_t flags = spin_lock_irqsave(&log_lock);
+  log_record_t *record = &log_buf[log_seq % LOG_CAPACITY];
+  movable_t overwritten = log_seq >= LOG_CAPACITY ? record->text : MOVABLE_NONE;
+  record->seq = log_seq;
+  record->time_ns = clock_ns();
+  record->level = (uint8_t)level;
+  record->text = text;
+  str_copy(record->inline_msg, sizeof(record->inline_msg), text ? "" : msg);
   log_seq++;
+  spin_unlock_irqrestore(&log_lock, flags);
+  movable_free(overwritten);
+  /* Outside log_lock: the scheduler lock may already be held above us. */
+  (void)wake_up(&log_waiters);
 }
 
 void log_info(const char *msg)
@@ -48,16 +80,29 @@ void log_error(const char *msg)
 
 uint64_t log_latest_seq(void)
 {
-  return log_seq;
+  uint32_t flags = spin_lock_irqsave(&log_lock);
+  uint64_t seq = log_seq;
+  spin_unlock_irqrestore(&log_lock, flags);
+  return seq;
+}
+
+int log_wait(uint64_t seq, uint32_t timeout_ms)
+{
+  return wait_event_timeout(log_waiters, log_seq > seq, timeout_ms);
+}
+
+/* Call with log_lock held: log_seq is 64-bit and cannot be read in one go. */
+static uint64_t oldest_locked(void)
+{
+  return log_seq < LOG_CAPACITY ? 0 : log_seq - LOG_CAPACITY;
 }
 
 uint64_t log_oldest_seq(void)
 {
-  if (log_seq < LOG_CAPACITY)
-  {
-    return 0;
-  }
-  return log_seq - LOG_CAPACITY;
+  uint32_t flags = spin_lock_irqsave(&log_lock);
+  uint64_t oldest = oldest_locked();
+  spin_unlock_irqrestore(&log_lock, flags);
+  return oldest;
 }
 
 int log_read(uint64_t seq, log_entry_t *out)
@@ -67,17 +112,25 @@ int log_read(uint64_t seq, log_entry_t *out)
     return 0;
   }
 
-  if (seq >= log_seq)
+  uint32_t flags = spin_lock_irqsave(&log_lock);
+  if (seq >= log_seq || seq < oldest_locked())
   {
+    spin_unlock_irqrestore(&log_lock, flags);
     return 0;
   }
 
-  uint64_t oldest = log_oldest_seq();
-  if (seq < oldest)
+  const log_record_t *record = &log_buf[seq % LOG_CAPACITY];
+  out->seq = record->seq;
+  out->time_ns = record->time_ns;
+  out->level = record->level;
+  if (record->text)
   {
-    return 0;
+    out->msg[movable_read(record->text, out->msg, LOG_MSG_MAX - 1)] = '\0';
   }
-
-  *out = log_buf[seq % LOG_CAPACITY];
+  else
+  {
+    str_copy(out->msg, LOG_MSG_MAX, record->inline_msg);
+  }
+  spin_unlock_irqrestore(&log_lock, flags);
   return 1;
 }
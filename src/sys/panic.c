@@ -1,8 +1,13 @@
 #include "sys/panic.h"
+#include "arch/cpu.h"
+#include "arch/smp.h"
 #include "drivers/vga.h"
 #include "drivers/keyboard.h"
 #include "sys/power.h"
 #include "sys/log.h"
+#include "sys/clock.h"
+#include "lib/string.h"
+#include "lib/format.h"
 
 #include <stddef.h>
 #include <stdint.h>
@@ -23,77 +28,9 @@ static char log_level_char(uint8_t level)
   }
 }
 
-static uint64_t u64_div_u32(uint64_t value, uint32_t divisor, uint32_t *remainder)
-{
-  uint64_t quotient = 0;
-  uint64_t rem = 0;
-
-  for (int i = 63; i >= 0; --i)
-  {
-    rem = (rem << 1) | ((value >> i) & 1u);
-    if (rem >= divisor)
-    {
-      rem -= divisor;
-      quotient |= (1ull << i);
-    }
-  }
-
-  if (remainder)
-  {
-    *remainder = (uint32_t)rem;
-  }
-  return quotient;
-}
-
-static void u64_to_str(uint64_t value, char *buf, size_t len)
-{
-  if (!buf || len == 0)
-  {
-    return;
-  }
-
-  size_t i = 0;
-  if (value == 0)
-  {
-    buf[i++] = '0';
-    buf[i] = '\0';
-    return;
-  }
-
-  while (value > 0 && i < len - 1)
-  {
-    uint32_t rem = 0;
-    value = u64_div_u32(value, 10, &rem);
-    buf[i++] = (char)('0' + rem);
-  }
-
-  for (size_t j = 0; j < i / 2; ++j)
-  {
-    char tmp = buf[j];
-    buf[j] = buf[i - 1 - j];
-    buf[i - 1 - j] = tmp;
-  }
-
-  buf[i] = '\0';
-}
-
-static size_t str_len(const char *text)
-{
-  size_t len = 0;
-  if (!text)
-  {
-    return 0;
-  }
-  while (text[len] != '\0')
-  {
-    len++;
-  }
-  return len;
-}
-
 static void write_center(uint16_t row, const char *text)
 {
-  size_t len = str_len(text);
+  size_t len = text ? strlen(text) : 0;
   uint16_t col = 0;
   if (len < VGA_WIDTH)
   {
@@ -105,24 +42,24 @@ static void write_center(uint16_t row, const char *text)
 static void write_hline(uint16_t row, char ch)
 {
   char line[VGA_WIDTH + 1];
-  for (size_t i = 0; i < VGA_WIDTH; ++i)
-  {
-    line[i] = ch;
-  }
+  memset(line, ch, VGA_WIDTH);
   line[VGA_WIDTH] = '\0';
   vga_write(line, row, 0);
 }
 
 static void write_kv_line(uint16_t row, const char *label, uint64_t value)
 {
-  char num[21];
-  u64_to_str(value, num, sizeof(num));
+  char num[FMT_U64_MAX];
+  fmt_u64(num, value);
   vga_write(label, row, 0);
-  vga_write(num, row, 12);
+  vga_write(num, row, 14);
 }
 
 void panic(const char *message)
 {
+  cpu_irq_disable();
+  smp_stop_others();
+  vga_emergency();
   vga_set_color(0x0F, 0x04);
   vga_clear();
   write_hline(0, '=');
@@ -141,6 +78,10 @@ void panic(const char *message)
     vga_write(message, row++, 4);
   }
 
+  vga_set_color(0x0B, 0x04);
+  write_kv_line(row++, "Uptime ms:", u64_div_u32(clock_ns(), CLOCK_NS_PER_MS, 0));
+  vga_set_color(0x0F, 0x04);
+
   uint64_t latest = log_latest_seq();
   if (latest > 0)
   {
@@ -149,7 +90,7 @@ void panic(const char *message)
     if (log_read(last_seq, &entry))
     {
       vga_set_color(0x0B, 0x04);
-      write_kv_line(row++, "Last tick:", entry.tick);
+      write_kv_line(row++, "Last log ms:", u64_div_u32(entry.time_ns, CLOCK_NS_PER_MS, 0));
       vga_set_color(0x0F, 0x04);
     }
   }
@@ -211,7 +152,7 @@ void panic(const char *message)
 
   for (;;)
   {
-    if (keyboard_poll_key() != 0)
+    if (keyboard_poll_raw() != 0)
     {
       power_reboot();
     }
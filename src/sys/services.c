@@ -1,8 +1,12 @@
 #include "sys/services.h"
 #include "proc/process.h"
+#include "proc/sync.h"
+#include "proc/workqueue.h"
+#include "proc/task.h"
 #include "sys/watchdog.h"
 #include "terminal/terminal.h"
 #include "sys/log.h"
+#include "lib/string.h"
 
 typedef struct
 {
@@ -17,21 +21,22 @@ typedef struct
   int restart_attempts;
   int restart_limit;
   int running;
+  uint8_t priority;
+  int (*probe)(void);
+  work_t restart_work;
 } service_t;
 
-static int str_eq(const char *a, const char *b)
-{
-  while (*a && *b)
-  {
-    if (*a != *b)
-    {
-      return 0;
-    }
-    a++;
-    b++;
-  }
-  return *a == '\0' && *b == '\0';
-}
+/* Milliseconds between health probes of the running services. */
+#define SERVICES_PROBE_MS 1000
+
+static task_t watchdog_task_state;
+static task_t services_probe_task;
+
+/*
+ * Serializes start/stop/restart between the shell and the kworker that
+ * performs automatic restarts. The unlocked helpers recurse for deps.
+ */
+static mutex_t services_mutex;
 
 static void service_log_event(const char *name, const char *event)
 {
@@ -59,28 +64,6 @@ static void service_log_event(const char *name, const char *event)
   log_info(buf);
 }
 
-static uint32_t find_process_pid(const char *name, size_t *index_out)
-{
-  size_t count = process_count();
-  for (size_t i = 0; i < count; ++i)
-  {
-    if (!process_is_used(i))
-    {
-      continue;
-    }
-    const char *proc_name = process_name(i);
-    if (proc_name && str_eq(proc_name, name))
-    {
-      if (index_out)
-      {
-        *index_out = i;
-      }
-      return process_pid(i);
-    }
-  }
-  return 0;
-}
-
 static int service_tty_start(void)
 {
   log_info("service:tty start");
@@ -95,42 +78,47 @@ static int service_tty_stop(void)
 
 static int service_watchdog_start(void)
 {
-  if (process_create("watchdog", watchdog_process, 0, 2048) != 0)
-  {
-    return -1;
-  }
   watchdog_reset();
+  task_spawn(&watchdog_task_state, "watchdog", watchdog_task, 0);
   return 0;
 }
 
 static int service_watchdog_stop(void)
 {
-  size_t idx = 0;
-  uint32_t pid = find_process_pid("watchdog", &idx);
-  if (pid)
-  {
-    (void)process_kill(pid, 1);
-  }
+  task_cancel(&watchdog_task_state);
   return 0;
 }
 
 static const char *watchdog_deps[] = {"tty"};
 
+/*
+ * tty has no process of its own; its input is consumed by the shell, which
+ * init raises to the same interactive priority. The watchdog is a task on
+ * the executor, which already runs at high priority.
+ */
 static service_t kservices[] = {
-    {"tty", service_tty_start, service_tty_stop, 0, 0, 0, 0, 0, 0, 0, 0},
+    {"tty", service_tty_start, service_tty_stop, 0, 0, 0, 0, 0, 0, 0, 0,
+     PROCESS_PRIO_INTERACTIVE, 0, {0}},
     {"watchdog", service_watchdog_start, service_watchdog_stop,
-     watchdog_deps, 1, 1, 0, 0, 0, 3, 0},
+     watchdog_deps, 1, 1, 0, 0, 0, 3, 0, PROCESS_PRIO_HIGH,
+     watchdog_healthy, {0}},
 };
 
+static void service_restart_work(void *arg);
+static int services_probe(task_t *task);
+
 void services_init(void)
 {
+  mutex_init(&services_mutex);
   for (size_t i = 0; i < (sizeof(kservices) / sizeof(kservices[0])); ++i)
   {
     kservices[i].running = 0;
     kservices[i].starting = 0;
     kservices[i].stop_requested = 0;
     kservices[i].restart_attempts = 0;
+    work_init(&kservices[i].restart_work, service_restart_work, &kservices[i]);
   }
+  task_spawn(&services_probe_task, "svc-probe", services_probe, 0);
 }
 
 size_t services_count(void)
@@ -216,7 +204,7 @@ int services_find(const char *name, size_t *index_out)
   return -1;
 }
 
-int services_start(const char *name)
+static int service_start_locked(const char *name)
 {
   size_t index = 0;
   if (services_find(name, &index) != 0)
@@ -237,7 +225,7 @@ int services_start(const char *name)
   for (size_t i = 0; i < kservices[index].dep_count; ++i)
   {
     const char *dep = kservices[index].deps[i];
-    if (dep && services_start(dep) != 0)
+    if (dep && service_start_locked(dep) != 0)
     {
       kservices[index].starting = 0;
       log_error("service:dep start failed");
@@ -250,14 +238,35 @@ int services_start(const char *name)
     kservices[index].starting = 0;
     return -1;
   }
+  uint32_t pid = process_find(name);
+  if (pid)
+  {
+    (void)process_set_priority(pid, kservices[index].priority);
+  }
   kservices[index].running = 1;
   kservices[index].starting = 0;
-  kservices[index].restart_attempts = 0;
   service_log_event(name, "started");
   return 0;
 }
 
-int services_stop(const char *name)
+int services_start(const char *name)
+{
+  mutex_lock(&services_mutex);
+  int result = service_start_locked(name);
+  if (result == 0)
+  {
+    size_t index = 0;
+    if (services_find(name, &index) == 0)
+    {
+      /* An explicit start gives autorestart a fresh budget. */
+      kservices[index].restart_attempts = 0;
+    }
+  }
+  mutex_unlock(&services_mutex);
+  return result;
+}
+
+static int service_stop_locked(const char *name)
 {
   size_t index = 0;
   if (services_find(name, &index) != 0)
@@ -278,13 +287,24 @@ int services_stop(const char *name)
   return 0;
 }
 
+int services_stop(const char *name)
+{
+  mutex_lock(&services_mutex);
+  int result = service_stop_locked(name);
+  mutex_unlock(&services_mutex);
+  return result;
+}
+
 int services_restart(const char *name)
 {
-  if (services_stop(name) != 0)
+  mutex_lock(&services_mutex);
+  int result = service_stop_locked(name);
+  if (result == 0)
   {
-    return -1;
+    result = service_start_locked(name);
   }
-  if (services_start(name) != 0)
+  mutex_unlock(&services_mutex);
+  if (result != 0)
   {
     return -1;
   }
@@ -292,6 +312,41 @@ int services_restart(const char *name)
   return 0;
 }
 
+/* Runs on a kworker, off the exit path that queued it. */
+static void service_restart_work(void *arg)
+{
+  service_t *svc = (service_t *)arg;
+  mutex_lock(&services_mutex);
+  if (!svc->running && !svc->stop_requested)
+  {
+    (void)service_start_locked(svc->name);
+  }
+  mutex_unlock(&services_mutex);
+}
+
+/*
+ * Called from reap_zombies inside the scheduler and from the probe task:
+ * only record the failure here and leave the restart to a kworker.
+ */
+static void service_mark_down(service_t *svc, const char *event)
+{
+  svc->running = 0;
+  service_log_event(svc->name, event);
+  if (svc->autorestart && !svc->stop_requested)
+  {
+    if (svc->restart_attempts < svc->restart_limit)
+    {
+      svc->restart_attempts++;
+      service_log_event(svc->name, "restarting");
+      (void)queue_work(&svc->restart_work);
+    }
+    else
+    {
+      service_log_event(svc->name, "restart-limit");
+    }
+  }
+}
+
 void services_on_process_exit(const char *name)
 {
   if (!name)
@@ -302,22 +357,26 @@ void services_on_process_exit(const char *name)
   {
     if (kservices[i].name && str_eq(kservices[i].name, name))
     {
-      kservices[i].running = 0;
-      service_log_event(name, "exited");
-      if (kservices[i].autorestart && !kservices[i].stop_requested)
+      service_mark_down(&kservices[i], "exited");
+      return;
+    }
+  }
+}
+
+static int services_probe(task_t *task)
+{
+  TASK_BEGIN(task);
+  for (;;)
+  {
+    TASK_SLEEP_MS(task, SERVICES_PROBE_MS);
+    for (size_t i = 0; i < services_count(); ++i)
+    {
+      service_t *svc = &kservices[i];
+      if (svc->running && !svc->starting && svc->probe && !svc->probe())
       {
-        if (kservices[i].restart_attempts < kservices[i].restart_limit)
-        {
-          kservices[i].restart_attempts++;
-          service_log_event(name, "restarting");
-          (void)services_start(name);
-        }
-        else
-        {
-          service_log_event(name, "restart-limit");
-        }
+        service_mark_down(svc, "unhealthy");
       }
-      return;
     }
   }
+  TASK_END(task);
 }
@@ -0,0 +1,192 @@
+#include "sys/timer.h"
+#include "arch/spinlock.h"
+#include "drivers/pit.h"
+
+#include <stddef.h>
+
+/*
+ * Hierarchical timer wheel: four levels of 64 slots. Level 0 resolves single
+ * ticks; each higher level covers 64x the range of the one below and is
+ * cascaded down one slot at a time as the lower level wraps. Adding,
+ * cancelling and expiring a timer are all O(1); a timer is moved at most
+ * once per level on its way down.
+ */
+
+#define TIMER_LEVELS 4
+#define TIMER_SLOT_BITS 6
+#define TIMER_SLOTS (1u << TIMER_SLOT_BITS)
+#define TIMER_SLOT_MASK (TIMER_SLOTS - 1)
+#define TIMER_MAX_DELTA ((1ull << (TIMER_LEVELS * TIMER_SLOT_BITS)) - 1)
+
+static ktimer_t *timer_wheel[TIMER_LEVELS][TIMER_SLOTS];
+static volatile uint64_t timer_now;
+static spinlock_t timer_lock = SPINLOCK_INIT;
+
+static void timer_unlink(ktimer_t *timer)
+{
+  *timer->pprev = timer->next;
+  if (timer->next)
+  {
+    timer->next->pprev = timer->pprev;
+  }
+  timer->next = 0;
+  timer->pprev = 0;
+}
+
+static void timer_enqueue(ktimer_t *timer)
+{
+  uint64_t expires = timer->expires;
+  if (expires < timer_now)
+  {
+    expires = timer_now;
+  }
+  uint64_t delta = expires - timer_now;
+  if (delta > TIMER_MAX_DELTA)
+  {
+    /* Parked in the last level; re-filed each time that slot cascades. */
+    delta = TIMER_MAX_DELTA;
+    expires = timer_now + delta;
+  }
+
+  size_t level = 0;
+  while (level + 1 < TIMER_LEVELS && delta >= (1ull << ((level + 1) * TIMER_SLOT_BITS)))
+  {
+    level++;
+  }
+
+  size_t slot = (size_t)((expires >> (level * TIMER_SLOT_BITS)) & TIMER_SLOT_MASK);
+  ktimer_t **head = &timer_wheel[level][slot];
+  timer->next = *head;
+  if (timer->next)
+  {
+    timer->next->pprev = &timer->next;
+  }
+  timer->pprev = head;
+  *head = timer;
+}
+
+/* Re-files every timer in one upper-level slot; returns the slot index. */
+static size_t timer_cascade(size_t level)
+{
+  size_t slot = (size_t)((timer_now >> (level * TIMER_SLOT_BITS)) & TIMER_SLOT_MASK);
+  ktimer_t *list = timer_wheel[level][slot];
+  timer_wheel[level][slot] = 0;
+
+  while (list)
+  {
+    ktimer_t *timer = list;
+    list = list->next;
+    timer->next = 0;
+    timer->pprev = 0;
+    timer_enqueue(timer);
+  }
+  return slot;
+}
+
+void timer_init(void)
+{
+  for (size_t level = 0; level < TIMER_LEVELS; ++level)
+  {
+    for (size_t slot = 0; slot < TIMER_SLOTS; ++slot)
+    {
+      timer_wheel[level][slot] = 0;
+    }
+  }
+  timer_now = 0;
+}
+
+void timer_setup(ktimer_t *timer, timer_fn_t fn, void *arg)
+{
+  timer->next = 0;
+  timer->pprev = 0;
+  timer->expires = 0;
+  timer->fn = fn;
+  timer->arg = arg;
+}
+
+uint32_t timer_ms_to_ticks(uint32_t ms)
+{
+  uint32_t ticks = (ms / 1000u) * PIT_TICK_HZ + ((ms % 1000u) * PIT_TICK_HZ + 999u) / 1000u;
+  return ticks ? ticks : 1;
+}
+
+void timer_start(ktimer_t *timer, uint32_t ms)
+{
+  uint32_t flags = spin_lock_irqsave(&timer_lock);
+  if (timer->pprev)
+  {
+    timer_unlink(timer);
+  }
+  timer->expires = timer_now + timer_ms_to_ticks(ms);
+  timer_enqueue(timer);
+  spin_unlock_irqrestore(&timer_lock, flags);
+}
+
+int timer_cancel(ktimer_t *timer)
+{
+  uint32_t flags = spin_lock_irqsave(&timer_lock);
+  int was_pending = timer->pprev != 0;
+  if (was_pending)
+  {
+    timer_unlink(timer);
+  }
+  spin_unlock_irqrestore(&timer_lock, flags);
+  return was_pending;
+}
+
+int timer_pending(const ktimer_t *timer)
+{
+  return timer->pprev != 0;
+}
+
+/*
+ * Expired timers are taken off the wheel one at a time and run without
+ * timer_lock held, so callbacks can take other locks (the scheduler's does
+ * timer_start under its own) and a timer cancelled on another CPU meanwhile
+ * is simply no longer in the slot. Anything re-armed from a callback lands
+ * at least one tick ahead, never back in the slot being drained.
+ */
+void timer_tick(void)
+{
+  uint32_t flags = spin_lock_irqsave(&timer_lock);
+  size_t slot = (size_t)(timer_now & TIMER_SLOT_MASK);
+  if (slot == 0)
+  {
+    for (size_t level = 1; level < TIMER_LEVELS; ++level)
+    {
+      if (timer_cascade(level) != 0)
+      {
+        break;
+      }
+    }
+  }
+  timer_now++;
+
+  for (;;)
+  {
+    ktimer_t *timer = timer_wheel[0][slot];
+    if (!timer)
+    {
+      break;
+    }
+    timer_unlink(timer);
+    timer_fn_t fn = timer->fn;
+    void *arg = timer->arg;
+    spin_unlock_irqrestore(&timer_lock, flags);
+
+    if (fn)
+    {
+      fn(arg);
+    }
+    flags = spin_lock_irqsave(&timer_lock);
+  }
+  spin_unlock_irqrestore(&timer_lock, flags);
+}
+
+uint64_t timer_ticks(void)
+{
+  uint32_t flags = spin_lock_irqsave(&timer_lock);
+  uint64_t now = timer_now;
+  spin_unlock_irqrestore(&timer_lock, flags);
+  return now;
+}
@@ -1,42 +1,59 @@
 #include "sys/watchdog.h"
 #include "sys/panic.h"
-#include "proc/process.h"
+#include "sys/clock.h"
+#include "proc/task.h"
 
-static volatile uint64_t watchdog_last_kick_ticks;
-static const uint64_t watchdog_timeout = 2000000;
+static volatile uint64_t watchdog_last_kick_ns;
+static volatile uint64_t watchdog_last_check_ns;
+static const uint64_t watchdog_timeout = 2000ull * CLOCK_NS_PER_MS;
+
+/* Milliseconds between checks; the check itself is two loads. */
+#define WATCHDOG_PERIOD_MS 100
 
 void watchdog_kick(void)
 {
-  watchdog_last_kick_ticks = process_get_ticks();
+  watchdog_last_kick_ns = clock_ns();
 }
 
 void watchdog_reset(void)
 {
-  watchdog_last_kick_ticks = process_get_ticks();
+  watchdog_last_kick_ns = clock_ns();
+  watchdog_last_check_ns = watchdog_last_kick_ns;
 }
 
 uint64_t watchdog_last_kick(void)
 {
-  return watchdog_last_kick_ticks;
+  return watchdog_last_kick_ns;
 }
 
-uint64_t watchdog_timeout_ticks(void)
+uint64_t watchdog_timeout_ns(void)
 {
   return watchdog_timeout;
 }
 
-void watchdog_process(void *arg)
+int watchdog_healthy(void)
 {
-  (void)arg;
+  uint64_t now = clock_ns();
+  uint64_t last = watchdog_last_check_ns;
+  return now <= last || now - last <= 10ull * WATCHDOG_PERIOD_MS * CLOCK_NS_PER_MS;
+}
+
+int watchdog_task(task_t *task)
+{
+  TASK_BEGIN(task);
   watchdog_reset();
 
   for (;;)
   {
-    uint64_t now = process_get_ticks();
-    if ((now > watchdog_last_kick_ticks) && (now - watchdog_last_kick_ticks > watchdog_timeout))
+    uint64_t now = clock_ns();
+    uint64_t last = watchdog_last_kick_ns;
+    if ((now > last) && (now - last > watchdog_timeout))
     {
       panic("watchdog timeout");
     }
-    process_yield();
+    watchdog_last_check_ns = now;
+    TASK_SLEEP_MS(task, WATCHDOG_PERIOD_MS);
   }
+
+  TASK_END(task);
 }
@@ -3,14 +3,7 @@
 #include "drivers/keyboard.h"
 #include "proc/process.h"
 #include "sys/watchdog.h"
-
-static void terminal_puts(const char *str)
-{
-  while (*str)
-  {
-    vga_putc(*str++);
-  }
-}
+#include "lib/string.h"
 
 static void terminal_redraw_line(const char *buffer, size_t len, size_t cursor,
                                  uint16_t start_row, uint16_t start_col, size_t prev_len)
@@ -32,22 +25,6 @@ static void terminal_redraw_line(const char *buffer, size_t len, size_t cursor,
   vga_set_cursor(cursor_row, cursor_col);
 }
 
-static size_t terminal_str_copy(char *dst, size_t dst_len, const char *src)
-{
-  size_t i = 0;
-  if (dst_len == 0)
-  {
-    return 0;
-  }
-  while (src && src[i] && i < dst_len - 1)
-  {
-    dst[i] = src[i];
-    i++;
-  }
-  dst[i] = '\0';
-  return i;
-}
-
 void terminal_init(void)
 {
   vga_set_color(0x0F, 0x00);
@@ -61,12 +38,12 @@ void terminal_clear(void)
 
 void terminal_write(const char *str)
 {
-  terminal_puts(str);
+  vga_puts(str);
 }
 
 void terminal_writeln(const char *str)
 {
-  terminal_puts(str);
+  vga_puts(str);
   vga_putc('\n');
 }
 
@@ -82,12 +59,9 @@ size_t terminal_readline(char *buffer, size_t max_len)
 
   for (;;)
   {
-    int key = keyboard_poll_key();
-    if (key == KEY_NONE)
-    {
-      process_yield();
-      continue;
-    }
+    /* Whatever was drawn so far, prompt and echo included, shows before we block. */
+    vga_flush();
+    int key = keyboard_read_key();
 
     if (key == '\n' || key == '\r')
     {
@@ -156,7 +130,7 @@ size_t terminal_readline(char *buffer, size_t max_len)
 }
 
 size_t terminal_readline_history(char *buffer, size_t max_len,
-                                 const char **history, size_t history_len,
+                                 terminal_history_fn history, size_t history_len,
                                  size_t *history_pos,
                                  char *scratch, size_t scratch_len)
 {
@@ -176,12 +150,8 @@ size_t terminal_readline_history(char *buffer, size_t max_len,
 
   for (;;)
   {
-    int key = keyboard_poll_key();
-    if (key == KEY_NONE)
-    {
-      process_yield();
-      continue;
-    }
+    vga_flush();
+    int key = keyboard_read_key();
 
     if (key == '\n' || key == '\r')
     {
@@ -239,7 +209,7 @@ size_t terminal_readline_history(char *buffer, size_t max_len,
 
       if (!using_history)
       {
-        terminal_str_copy(scratch, scratch_len, buffer);
+        str_copy(scratch, scratch_len, buffer);
         using_history = 1;
       }
 
@@ -260,12 +230,12 @@ size_t terminal_readline_history(char *buffer, size_t max_len,
 
       if (*history_pos >= history_len)
       {
-        len = terminal_str_copy(buffer, max_len, scratch);
+        len = str_copy(buffer, max_len, scratch);
         using_history = 0;
       }
       else
       {
-        len = terminal_str_copy(buffer, max_len, history[*history_pos]);
+        len = history(*history_pos, buffer, max_len);
       }
       cursor = len;
       terminal_redraw_line(buffer, len, cursor, start_row, start_col, prev_len);